@@ -4,6 +4,32 @@
 #include "base/Time.hpp"
 
 namespace gamepad_websocket {
+    /* What to do with a new connection when the maximum number of clients is reached */
+    enum ClientAdmissionPolicy {
+        /* Refuse the new connection */
+        REJECT_NEW_CLIENTS,
+        /* Close the oldest connection to make room for the new one */
+        EVICT_OLDEST_CLIENT
+    };
+
+    /* What to do with samples older than the configured maximum age */
+    enum StaleSamplePolicy {
+        /* Do not publish stale samples */
+        DROP_STALE_SAMPLES,
+        /* Publish stale samples with their age in milliseconds in the "age" field */
+        TAG_STALE_SAMPLES
+    };
+
+    /* Minimum level of the messages of the websocket servers that are logged */
+    enum ServerLogLevel {
+        SERVER_LOG_DEBUG,
+        SERVER_LOG_ACCESS,
+        SERVER_LOG_INFO,
+        SERVER_LOG_WARNING,
+        SERVER_LOG_ERROR,
+        SERVER_LOG_SEVERE
+    };
+
     struct SocketStatistics {
         /* Time of the last sent message, that is the time it was generated */
         base::Time last_sent_message;
@@ -13,6 +39,8 @@ namespace gamepad_websocket {
         uint64_t received = 0;
         /* Count of messages sent */
         uint64_t sent = 0;
+        /* Sequence number of the last sample sent to this socket */
+        uint64_t last_sent_sequence = 0;
     };
 
     struct Statistics {
@@ -20,6 +48,40 @@ namespace gamepad_websocket {
         base::Time time;
         /* The statistics of all currently active sockets */
         std::vector<SocketStatistics> sockets_statistics;
+        /* Count of samples received by the task */
+        uint64_t received_samples = 0;
+        /* Count of samples not published because they did not change the
+         * published state meaningfully. They do not get a sequence number. */
+        uint64_t filtered_samples = 0;
+        /* Count of samples replaced by a newer one before they could be published */
+        uint64_t overwritten_samples = 0;
+        /* For each server shard, the count of frames it did not send to its
+         * clients because a newer one was already queued. Unlike
+         * overwritten_samples, this includes the frames that another shard did
+         * send. */
+        std::vector<uint64_t> skipped_frames;
+        /* Sequence number of the last published sample */
+        uint64_t last_published_sequence = 0;
+        /* Count of samples that were older than the maximum sample age when they
+         * were about to be sent, whether they were dropped or tagged */
+        uint64_t stale_samples = 0;
+        /* Count of connections refused because the maximum number of clients was
+         * reached */
+        uint64_t rejected_clients = 0;
+        /* Count of connections closed to make room for a new one */
+        uint64_t evicted_clients = 0;
+        /* Count of samples that changed a priority button */
+        uint64_t priority_samples = 0;
+        /* Time between the reception of the last priority sample by the task and
+         * its sending to the clients of a shard */
+        base::Time last_priority_latency;
+        /* Maximum of last_priority_latency since the task started */
+        base::Time max_priority_latency;
+        /* Count of frames sent on the UDP side channel */
+        uint64_t udp_datagrams = 0;
+        /* Count of frames that could not be sent on the UDP side channel, because
+         * the socket buffer was full or the frame too large for a datagram */
+        uint64_t udp_send_failures = 0;
     };
 }
 
@@ -0,0 +1,83 @@
+#ifndef GAMEPAD_WEBSOCKET_SHM_LAYOUT_HPP
+#define GAMEPAD_WEBSOCKET_SHM_LAYOUT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace gamepad_websocket {
+    namespace shm {
+        /*
+         * Binary layout of the shared memory segment written by the websocket
+         * publisher tasks when shm_name is set.
+         *
+         * The segment is a Header followed by Header::capacity slots. Each
+         * sample is written in the slot of index write_index % capacity, after
+         * which write_index is incremented. Slots are protected by a sequence
+         * lock: their lock is odd while the writer modifies them, and readers
+         * retry if it was odd or changed while they copied the slot.
+         *
+         * The layout only uses fixed-size types, so that readers do not need to
+         * be built against the same compiler or libraries as the writer.
+         */
+
+        /* "GPWS", written last when the segment is initialized */
+        static constexpr uint32_t MAGIC = 0x53575047;
+        static constexpr uint32_t VERSION = 1;
+
+        /* Axes and buttons beyond these counts are not written */
+        static constexpr size_t MAX_AXES = 32;
+        static constexpr size_t MAX_BUTTONS = 64;
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free,
+            "the shared memory layout needs lock-free 64 bit atomics");
+
+        /* A raw command, as published by the task */
+        struct SampleData {
+            /* Sequence number given by the task, see the "seq" field of the
+             * websocket messages */
+            uint64_t sequence;
+            /* Time of the raw command, in microseconds since the Unix epoch */
+            int64_t time;
+            uint32_t axis_count;
+            uint32_t button_count;
+            double axes[MAX_AXES];
+            uint8_t buttons[MAX_BUTTONS];
+        };
+
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> lock;
+            /* Index of the write that filled the slot */
+            uint64_t index;
+            SampleData data;
+        };
+
+        struct alignas(64) Header {
+            std::atomic<uint32_t> magic;
+            uint32_t version;
+            uint32_t capacity;
+            uint32_t slot_size;
+            /* Count of samples written so far. The latest one has index
+             * write_index - 1 */
+            alignas(64) std::atomic<uint64_t> write_index;
+        };
+
+        /* Size of a segment holding the given number of slots */
+        inline size_t segmentSize(uint32_t capacity)
+        {
+            return sizeof(Header) + capacity * sizeof(Slot);
+        }
+
+        inline Slot* slots(Header* header)
+        {
+            return reinterpret_cast<Slot*>(header + 1);
+        }
+
+        inline Slot const* slots(Header const* header)
+        {
+            return reinterpret_cast<Slot const*>(header + 1);
+        }
+    }
+}
+
+#endif
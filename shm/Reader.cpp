@@ -0,0 +1,107 @@
+#include "Reader.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace gamepad_websocket::shm;
+using namespace std;
+
+/* Number of times a read is attempted while the slot is being written */
+static constexpr int READ_ATTEMPTS = 16;
+
+Reader::~Reader()
+{
+    close();
+}
+
+bool Reader::open(string const& name)
+{
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) < 0 ||
+        static_cast<size_t>(status.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = status.st_size;
+    void* memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    auto header = static_cast<Header const*>(memory);
+    if (header->magic.load(memory_order_acquire) != MAGIC ||
+        header->version != VERSION || header->slot_size != sizeof(Slot) ||
+        segmentSize(header->capacity) > size) {
+        munmap(memory, size);
+        return false;
+    }
+    m_header = header;
+    m_size = size;
+    return true;
+}
+
+void Reader::close()
+{
+    if (m_header) {
+        munmap(const_cast<Header*>(m_header), m_size);
+        m_header = nullptr;
+        m_size = 0;
+    }
+}
+
+bool Reader::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+uint32_t Reader::capacity() const
+{
+    return m_header->capacity;
+}
+
+uint64_t Reader::writeIndex() const
+{
+    return m_header->write_index.load(memory_order_acquire);
+}
+
+bool Reader::latest(SampleData& sample) const
+{
+    uint64_t write_index = writeIndex();
+    if (write_index == 0) {
+        return false;
+    }
+    return read(write_index - 1, sample);
+}
+
+bool Reader::read(uint64_t index, SampleData& sample) const
+{
+    uint64_t write_index = writeIndex();
+    if (index >= write_index || write_index - index > m_header->capacity) {
+        return false;
+    }
+
+    auto const& slot = slots(m_header)[index % m_header->capacity];
+    for (int i = 0; i < READ_ATTEMPTS; ++i) {
+        uint64_t before = slot.lock.load(memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        uint64_t slot_index = slot.index;
+        memcpy(&sample, &slot.data, sizeof(sample));
+        atomic_thread_fence(memory_order_acquire);
+        if (slot.lock.load(memory_order_relaxed) == before) {
+            return slot_index == index;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+#ifndef GAMEPAD_WEBSOCKET_SHM_READER_HPP
+#define GAMEPAD_WEBSOCKET_SHM_READER_HPP
+
+#include "Layout.hpp"
+
+#include <string>
+
+namespace gamepad_websocket {
+    namespace shm {
+        /*
+         * Reads the samples published by a websocket publisher task in shared
+         * memory.
+         *
+         * Reading maps the segment and copies a single slot, without any system
+         * call nor allocation. It never blocks the writer: a read that overlaps
+         * with a write of the same slot is retried a few times, and fails if the
+         * writer keeps overwriting it.
+         */
+        class Reader {
+        public:
+            Reader() = default;
+            ~Reader();
+
+            Reader(Reader const&) = delete;
+            Reader& operator=(Reader const&) = delete;
+
+            /*
+             * Maps the segment of the given name, i.e. the task's shm_name.
+             * Returns false if it does not exist or is not a segment of a
+             * compatible layout.
+             */
+            bool open(std::string const& name);
+
+            void close();
+
+            bool isOpen() const;
+
+            /* The number of samples the segment holds */
+            uint32_t capacity() const;
+
+            /*
+             * Count of samples written so far. The index of the latest sample is
+             * writeIndex() - 1
+             */
+            uint64_t writeIndex() const;
+
+            /*
+             * Copies the latest sample. Returns false if there is none yet, or if
+             * it could not be read consistently
+             */
+            bool latest(SampleData& sample) const;
+
+            /*
+             * Copies the sample of the given write index. Returns false if it was
+             * not written yet, if it was already overwritten, or if it could not be
+             * read consistently
+             */
+            bool read(uint64_t index, SampleData& sample) const;
+
+        private:
+            Header const* m_header = nullptr;
+            size_t m_size = 0;
+        };
+    }
+}
+
+#endif
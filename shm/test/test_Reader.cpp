@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include <gamepad_websocket/shm/Reader.hpp>
+
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace gamepad_websocket::shm;
+using namespace std;
+
+/*
+ * Creates a segment the way the publisher tasks do, and writes samples in it
+ * following the protocol described in Layout.hpp
+ */
+struct TestSegment {
+    string name;
+    Header* header = nullptr;
+    size_t size = 0;
+
+    TestSegment(uint32_t capacity)
+        : name("/gamepad_websocket_test_reader_" + to_string(getpid()))
+    {
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        size = segmentSize(capacity);
+        if (fd < 0 || ftruncate(fd, size) < 0) {
+            throw runtime_error("failed to create the test segment");
+        }
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        header = new (memory) Header();
+        header->version = VERSION;
+        header->capacity = capacity;
+        header->slot_size = sizeof(Slot);
+        header->write_index.store(0);
+        for (uint32_t i = 0; i < capacity; ++i) {
+            new (&slots(header)[i]) Slot();
+        }
+        header->magic.store(MAGIC);
+    }
+
+    ~TestSegment()
+    {
+        munmap(header, size);
+        shm_unlink(name.c_str());
+    }
+
+    Slot& beginWrite()
+    {
+        uint64_t index = header->write_index.load();
+        auto& slot = slots(header)[index % header->capacity];
+        slot.lock.store(slot.lock.load() + 1);
+        slot.index = index;
+        return slot;
+    }
+
+    void endWrite(Slot& slot)
+    {
+        slot.lock.store(slot.lock.load() + 1);
+        header->write_index.store(header->write_index.load() + 1);
+    }
+
+    void write(uint64_t sequence, double axis)
+    {
+        auto& slot = beginWrite();
+        slot.data.sequence = sequence;
+        slot.data.time = sequence * 1000;
+        slot.data.axis_count = 1;
+        slot.data.axes[0] = axis;
+        slot.data.button_count = 1;
+        slot.data.buttons[0] = sequence % 2;
+        endWrite(slot);
+    }
+};
+
+TEST(ReaderTest, it_fails_to_open_a_segment_that_does_not_exist)
+{
+    Reader reader;
+    ASSERT_FALSE(reader.open("/gamepad_websocket_test_reader_does_not_exist"));
+    ASSERT_FALSE(reader.isOpen());
+}
+
+TEST(ReaderTest, it_fails_to_open_a_segment_that_is_not_initialized)
+{
+    TestSegment segment(4);
+    segment.header->magic.store(0);
+    Reader reader;
+    ASSERT_FALSE(reader.open(segment.name));
+}
+
+TEST(ReaderTest, it_fails_to_open_a_segment_of_another_version)
+{
+    TestSegment segment(4);
+    segment.header->version = VERSION + 1;
+    Reader reader;
+    ASSERT_FALSE(reader.open(segment.name));
+}
+
+TEST(ReaderTest, it_reports_no_sample_before_the_first_write)
+{
+    TestSegment segment(4);
+    Reader reader;
+    ASSERT_TRUE(reader.open(segment.name));
+    ASSERT_EQ(4u, reader.capacity());
+    ASSERT_EQ(0u, reader.writeIndex());
+    SampleData sample;
+    ASSERT_FALSE(reader.latest(sample));
+}
+
+TEST(ReaderTest, it_reads_the_latest_sample)
+{
+    TestSegment segment(4);
+    Reader reader;
+    ASSERT_TRUE(reader.open(segment.name));
+    segment.write(1, 0.1);
+    segment.write(2, 0.2);
+
+    SampleData sample;
+    ASSERT_TRUE(reader.latest(sample));
+    ASSERT_EQ(2u, sample.sequence);
+    ASSERT_EQ(2000, sample.time);
+    ASSERT_EQ(1u, sample.axis_count);
+    ASSERT_EQ(0.2, sample.axes[0]);
+    ASSERT_EQ(1u, sample.button_count);
+    ASSERT_EQ(0, sample.buttons[0]);
+}
+
+TEST(ReaderTest, it_reads_the_samples_still_in_the_ring)
+{
+    TestSegment segment(2);
+    Reader reader;
+    ASSERT_TRUE(reader.open(segment.name));
+    for (uint64_t i = 1; i <= 3; ++i) {
+        segment.write(i, i * 0.1);
+    }
+
+    SampleData sample;
+    ASSERT_FALSE(reader.read(0, sample));
+    ASSERT_TRUE(reader.read(1, sample));
+    ASSERT_EQ(2u, sample.sequence);
+    ASSERT_TRUE(reader.read(2, sample));
+    ASSERT_EQ(3u, sample.sequence);
+    ASSERT_FALSE(reader.read(3, sample));
+}
+
+TEST(ReaderTest, it_fails_to_read_a_slot_that_is_being_written)
+{
+    TestSegment segment(2);
+    Reader reader;
+    ASSERT_TRUE(reader.open(segment.name));
+    segment.write(1, 0.1);
+    segment.write(2, 0.2);
+    auto& slot = segment.beginWrite();
+
+    SampleData sample;
+    ASSERT_FALSE(reader.read(0, sample));
+    ASSERT_TRUE(reader.read(1, sample));
+    segment.endWrite(slot);
+}
@@ -0,0 +1,219 @@
+#include "AsyncLogger.hpp"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstring>
+#include <ctime>
+
+using namespace gamepad_websocket;
+using namespace seasocks;
+using namespace std;
+
+/* Time the writer thread sleeps when the ring is empty */
+static constexpr auto POLL_PERIOD = chrono::milliseconds(10);
+
+static int64_t currentTime()
+{
+    auto since_epoch = chrono::system_clock::now().time_since_epoch();
+    return chrono::duration_cast<chrono::microseconds>(since_epoch).count();
+}
+
+static uint64_t hashMessage(Logger::Level level, const char* message)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL ^ static_cast<uint64_t>(level);
+    for (; *message; ++message) {
+        hash ^= static_cast<unsigned char>(*message);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static size_t roundUpToPowerOfTwo(size_t value)
+{
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+AsyncLogger::AsyncLogger(Level level,
+    size_t capacity,
+    int64_t repeat_period_us,
+    FILE* output)
+    : m_level(static_cast<int>(level))
+    , m_repeat_period_us(repeat_period_us)
+    , m_output(output)
+{
+    capacity = roundUpToPowerOfTwo(capacity);
+    m_entries.reset(new Entry[capacity]);
+    m_mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i) {
+        m_entries[i].sequence.store(i, memory_order_relaxed);
+    }
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+    flush();
+}
+
+void AsyncLogger::start()
+{
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_quit.store(false, memory_order_relaxed);
+    m_thread = thread([this] { run(); });
+}
+
+void AsyncLogger::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+    m_quit.store(true, memory_order_release);
+    m_thread.join();
+}
+
+void AsyncLogger::setLevel(Level level)
+{
+    m_level.store(static_cast<int>(level), memory_order_relaxed);
+}
+
+void AsyncLogger::log(Level level, const char* message)
+{
+    if (static_cast<int>(level) < m_level.load(memory_order_relaxed)) {
+        return;
+    }
+
+    // Concurrent callers may race on the repeat detection, which at worst writes
+    // a repeated message more often than once per period
+    auto now = currentTime();
+    auto hash = hashMessage(level, message);
+    if (m_last_hash.load(memory_order_relaxed) == hash &&
+        now - m_last_time.load(memory_order_relaxed) < m_repeat_period_us) {
+        m_repeats.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    m_last_hash.store(hash, memory_order_relaxed);
+    m_last_time.store(now, memory_order_relaxed);
+    push(level, now, message);
+}
+
+void AsyncLogger::logf(Level level, const char* format, ...)
+{
+    if (static_cast<int>(level) < m_level.load(memory_order_relaxed)) {
+        return;
+    }
+
+    char message[MAX_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    log(level, message);
+}
+
+void AsyncLogger::push(Level level, int64_t time, const char* message)
+{
+    uint64_t position = m_enqueue_position.load(memory_order_relaxed);
+    Entry* entry = nullptr;
+    while (true) {
+        entry = &m_entries[position & m_mask];
+        uint64_t sequence = entry->sequence.load(memory_order_acquire);
+        auto diff = static_cast<int64_t>(sequence - position);
+        if (diff == 0) {
+            if (m_enqueue_position.compare_exchange_weak(position,
+                    position + 1,
+                    memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            m_dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        else {
+            position = m_enqueue_position.load(memory_order_relaxed);
+        }
+    }
+
+    entry->level = level;
+    entry->time = time;
+    entry->repeats = m_repeats.exchange(0, memory_order_relaxed);
+    strncpy(entry->message, message, MAX_MESSAGE_SIZE - 1);
+    entry->message[MAX_MESSAGE_SIZE - 1] = '\0';
+    entry->sequence.store(position + 1, memory_order_release);
+}
+
+void AsyncLogger::run()
+{
+    while (!m_quit.load(memory_order_acquire)) {
+        if (!writePending()) {
+            this_thread::sleep_for(POLL_PERIOD);
+        }
+    }
+    flush();
+}
+
+void AsyncLogger::flush()
+{
+    writePending();
+    writeRepeats(m_repeats.exchange(0, memory_order_relaxed));
+    fflush(m_output);
+}
+
+bool AsyncLogger::writePending()
+{
+    bool written = false;
+    while (true) {
+        auto& entry = m_entries[m_dequeue_position & m_mask];
+        if (entry.sequence.load(memory_order_acquire) != m_dequeue_position + 1) {
+            break;
+        }
+        write(entry);
+        entry.sequence.store(m_dequeue_position + m_mask + 1, memory_order_release);
+        m_dequeue_position++;
+        written = true;
+    }
+
+    uint64_t dropped = m_dropped.exchange(0, memory_order_relaxed);
+    if (dropped != 0) {
+        fprintf(m_output,
+            "WARNING: dropped %" PRIu64 " log messages, the log ring is full\n",
+            dropped);
+        written = true;
+    }
+    if (written) {
+        fflush(m_output);
+    }
+    return written;
+}
+
+void AsyncLogger::write(Entry const& entry)
+{
+    writeRepeats(entry.repeats);
+
+    time_t seconds = entry.time / 1000000;
+    tm local_time;
+    localtime_r(&seconds, &local_time);
+    char date[32];
+    strftime(date, sizeof(date), "%Y%m%d-%H:%M:%S", &local_time);
+    fprintf(m_output,
+        "%s.%06d %s: %s\n",
+        date,
+        static_cast<int>(entry.time % 1000000),
+        levelToString(entry.level),
+        entry.message);
+}
+
+void AsyncLogger::writeRepeats(uint64_t repeats)
+{
+    if (repeats != 0) {
+        fprintf(m_output, "previous message repeated %" PRIu64 " times\n", repeats);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef GAMEPAD_WEBSOCKET_ASYNCLOGGER_HPP
+#define GAMEPAD_WEBSOCKET_ASYNCLOGGER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <seasocks/Logger.h>
+#include <thread>
+
+namespace gamepad_websocket {
+    /*
+     * A seasocks logger that writes the messages from a thread of its own.
+     *
+     * The writer thread only runs between start() and stop(), so that an idle
+     * logger costs no wakeups. Messages logged while it is stopped are kept in the
+     * ring until it starts again, or until the logger is destroyed.
+     *
+     * Messages below the configured level are discarded right away. The others are
+     * copied, truncated to MAX_MESSAGE_SIZE, into a fixed-size lock-free ring that
+     * the writer thread drains, timestamps and prints. Logging therefore never
+     * blocks nor allocates in the calling thread, which is usually a server
+     * thread. Messages logged while the ring is full are dropped, and their count
+     * is reported by the writer thread.
+     *
+     * A message identical to the previous one is only written once per repeat
+     * period, followed by the number of times it was repeated.
+     */
+    class AsyncLogger : public seasocks::Logger {
+    public:
+        /* Size of the message buffers, including the terminating zero */
+        static constexpr size_t MAX_MESSAGE_SIZE = 256;
+
+        /*
+         * @param level the minimum level of the messages that are written
+         * @param capacity the number of messages the ring can hold, rounded up to a
+         *   power of two
+         * @param repeat_period_us minimum time between two writes of the same
+         *   message, in microseconds
+         * @param output the stream the messages are written to
+         */
+        explicit AsyncLogger(Level level = Level::Info,
+            size_t capacity = 1024,
+            int64_t repeat_period_us = 1000000,
+            FILE* output = stdout);
+
+        /*
+         * Stops the writer thread and writes the messages still in the ring
+         */
+        ~AsyncLogger() override;
+
+        /*
+         * Starts the writer thread. Does nothing if it is already running
+         */
+        void start();
+
+        /*
+         * Writes the messages in the ring and stops the writer thread. Does nothing
+         * if it is not running
+         */
+        void stop();
+
+        void setLevel(Level level);
+
+        void log(Level level, const char* message) override;
+
+        /*
+         * Formats the message in a buffer on the stack and logs it
+         */
+        void logf(Level level, const char* format, ...)
+            __attribute__((format(printf, 3, 4)));
+
+    private:
+        struct Entry {
+            /* Position of the entry in the ring, as defined by the bounded MPMC
+             * queue algorithm of D. Vyukov */
+            std::atomic<uint64_t> sequence{0};
+            Level level = Level::Info;
+            int64_t time = 0;
+            /* Number of times the previous message was suppressed as a repeat */
+            uint64_t repeats = 0;
+            char message[MAX_MESSAGE_SIZE];
+        };
+
+        std::unique_ptr<Entry[]> m_entries;
+        uint64_t m_mask = 0;
+        std::atomic<uint64_t> m_enqueue_position{0};
+        uint64_t m_dequeue_position = 0;
+
+        std::atomic<int> m_level;
+        std::atomic<uint64_t> m_dropped{0};
+
+        int64_t m_repeat_period_us = 0;
+        std::atomic<uint64_t> m_last_hash{0};
+        std::atomic<int64_t> m_last_time{0};
+        std::atomic<uint64_t> m_repeats{0};
+
+        FILE* m_output = nullptr;
+        std::atomic<bool> m_quit{false};
+        std::thread m_thread;
+
+        void push(Level level, int64_t time, const char* message);
+        void run();
+        void flush();
+        bool writePending();
+        void write(Entry const& entry);
+        void writeRepeats(uint64_t repeats);
+    };
+}
+
+#endif
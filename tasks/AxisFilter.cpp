@@ -0,0 +1,121 @@
+#include "AxisFilter.hpp"
+
+#include <cmath>
+
+using namespace controldev;
+using namespace gamepad_websocket;
+using namespace std;
+
+// The loops below work on contiguous doubles and are written without early exits
+// so that the compiler can vectorize them
+
+static void applyDeadband(double* axes, double const* deadband, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        axes[i] = fabs(axes[i]) < deadband[i] ? 0.0 : axes[i];
+    }
+}
+
+static void applyQuantization(double* axes, double const* step, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        axes[i] = step[i] > 0 ? nearbyint(axes[i] / step[i]) * step[i] : axes[i];
+    }
+}
+
+static bool hasMinChange(double const* a,
+    double const* b,
+    double const* min_change,
+    size_t size)
+{
+    bool changed = false;
+    for (size_t i = 0; i < size; ++i) {
+        double diff = fabs(a[i] - b[i]);
+        changed |= diff > 0 && diff >= min_change[i];
+    }
+    return changed;
+}
+
+static bool hasPositive(vector<double> const& values)
+{
+    for (auto value : values) {
+        if (value > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Expands a parameter given for all the axes, or per axis, to one per axis */
+static void expand(vector<double>& expanded,
+    vector<double> const& parameter,
+    size_t axis_count)
+{
+    if (parameter.size() > 1) {
+        expanded = parameter;
+    }
+    else {
+        expanded.assign(axis_count, parameter.empty() ? 0.0 : parameter.front());
+    }
+}
+
+AxisFilter::AxisFilter(Configuration const& configuration)
+    : m_configuration(configuration)
+{
+}
+
+bool AxisFilter::isEnabled() const
+{
+    return hasPositive(m_configuration.deadband) ||
+           hasPositive(m_configuration.quantization) ||
+           hasPositive(m_configuration.min_change);
+}
+
+size_t AxisFilter::axisCount() const
+{
+    size_t count = 0;
+    for (auto const* parameter : {&m_configuration.deadband,
+             &m_configuration.quantization,
+             &m_configuration.min_change}) {
+        if (parameter->size() > 1) {
+            count = parameter->size();
+        }
+    }
+    return count;
+}
+
+bool AxisFilter::update(RawCommand& raw_command)
+{
+    auto& axes = raw_command.axisValue;
+    if (m_deadband.size() != axes.size()) {
+        expand(m_deadband, m_configuration.deadband, axes.size());
+        expand(m_quantization, m_configuration.quantization, axes.size());
+        expand(m_min_change, m_configuration.min_change, axes.size());
+    }
+    applyDeadband(axes.data(), m_deadband.data(), axes.size());
+    applyQuantization(axes.data(), m_quantization.data(), axes.size());
+
+    bool changed = !m_has_last || axes.size() != m_last_axes.size() ||
+                   raw_command.buttonValue != m_last_buttons;
+    if (!changed) {
+        changed = hasMinChange(axes.data(),
+            m_last_axes.data(),
+            m_min_change.data(),
+            axes.size());
+    }
+    if (!changed) {
+        return false;
+    }
+
+    m_has_last = true;
+    m_last_axes = axes;
+    m_last_buttons = raw_command.buttonValue;
+    return true;
+}
+
+void AxisFilter::reset()
+{
+    m_has_last = false;
+    m_last_axes.clear();
+    m_last_buttons.clear();
+}
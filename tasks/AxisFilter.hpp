@@ -0,0 +1,74 @@
+#ifndef GAMEPAD_WEBSOCKET_AXISFILTER_HPP
+#define GAMEPAD_WEBSOCKET_AXISFILTER_HPP
+
+#include "controldev/RawCommand.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gamepad_websocket {
+    /*
+     * Removes the noise of analog axes before a raw command is published, and tells
+     * whether the result is worth publishing.
+     *
+     * Axis values are first zeroed when within the deadband, and then rounded to
+     * the quantization step. The command is then considered a change if a button
+     * changed or if an axis moved by at least the minimum change since the last
+     * accepted command. Comparing against the last accepted command, and not the
+     * last received one, ensures that slow drifts are eventually published.
+     *
+     * All parameters are given per axis. A parameter with a single element applies
+     * to all the axes, and an empty one is the same as a single zero.
+     */
+    class AxisFilter {
+    public:
+        struct Configuration {
+            /* Axis values whose magnitude is below this are set to zero */
+            std::vector<double> deadband;
+            /* Step to which axis values are rounded. Zero disables rounding */
+            std::vector<double> quantization;
+            /* Minimum axis change for a command to be accepted. Zero accepts any
+             * change, but still rejects identical commands. */
+            std::vector<double> min_change;
+        };
+
+        AxisFilter() = default;
+        explicit AxisFilter(Configuration const& configuration);
+
+        /*
+         * Whether the configuration does anything at all
+         */
+        bool isEnabled() const;
+
+        /*
+         * The number of axes the configuration is given for, or zero if all its
+         * parameters apply to any number of axes. Commands with another number of
+         * axes must not be passed to update().
+         */
+        size_t axisCount() const;
+
+        /*
+         * Filters the axes of the given command in place, and returns whether it
+         * changed enough from the last accepted one to be published. The command
+         * becomes the last accepted command if it did.
+         */
+        bool update(controldev::RawCommand& raw_command);
+
+        /*
+         * Forgets the last accepted command, so that the next one is accepted
+         */
+        void reset();
+
+    private:
+        Configuration m_configuration;
+        /* The parameters, with one element per axis of the last filtered command */
+        std::vector<double> m_deadband;
+        std::vector<double> m_quantization;
+        std::vector<double> m_min_change;
+        bool m_has_last = false;
+        std::vector<double> m_last_axes;
+        std::vector<uint8_t> m_last_buttons;
+    };
+}
+
+#endif
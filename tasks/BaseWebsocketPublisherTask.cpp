@@ -1,14 +1,16 @@
 /* Generated from orogen/lib/orogen/templates/tasks/Task.cpp */
 
 #include "BaseWebsocketPublisherTask.hpp"
+#include "AsyncLogger.hpp"
+#include "UdpPublisher.hpp"
 #include "WebsocketHandler.hpp"
 #include "base-logging/Logging.hpp"
 #include "controldev/RawCommand.hpp"
 #include "gamepad_websocketTypes.hpp"
 
+#include <limits>
 #include <memory>
 #include <mutex>
-#include <seasocks/PrintfLogger.h>
 #include <seasocks/Server.h>
 
 using namespace base;
@@ -16,23 +18,98 @@ using namespace gamepad_websocket;
 using namespace seasocks;
 using namespace std;
 
-CommandPublisher::CommandPublisher(shared_ptr<WebsocketHandler> handler)
+static Logger::Level toSeasocksLevel(ServerLogLevel level)
+{
+    switch (level) {
+        case SERVER_LOG_DEBUG:
+            return Logger::Level::Debug;
+        case SERVER_LOG_ACCESS:
+            return Logger::Level::Access;
+        case SERVER_LOG_INFO:
+            return Logger::Level::Info;
+        case SERVER_LOG_WARNING:
+            return Logger::Level::Warning;
+        case SERVER_LOG_ERROR:
+            return Logger::Level::Error;
+        default:
+            return Logger::Level::Severe;
+    }
+}
+
+/*
+ * Number of frames, and of publishers of each shard, kept for reuse. Beyond it,
+ * e.g. while a shard is stalled, they are allocated for a single use. This bounds
+ * both the memory held by the pools and the time spent looking for a free entry.
+ */
+static constexpr size_t POOL_SIZE_PER_SHARD = 4;
+
+/*
+ * Returns an element of the pool that nothing else refers to. If they are all in
+ * use, a new one is added to the pool, or allocated out of it if the pool already
+ * holds the given number of elements.
+ */
+template <typename T, typename... Args>
+static shared_ptr<T> acquireFromPool(vector<shared_ptr<T>>& pool,
+    size_t capacity,
+    Args&&... args)
+{
+    for (auto const& item : pool) {
+        if (item.use_count() == 1) {
+            // Synchronizes with the release of the reference held by the other
+            // thread, so that its writes to the item are visible
+            atomic_thread_fence(memory_order_acquire);
+            return item;
+        }
+    }
+    auto item = make_shared<T>(forward<Args>(args)...);
+    if (pool.size() < capacity) {
+        pool.push_back(item);
+    }
+    return item;
+}
+
+CommandPublisher::CommandPublisher(shared_ptr<WebsocketHandler> handler,
+    shared_ptr<Frame> frame)
+    : m_handler(handler)
+    , m_frame(frame)
+{
+}
+
+void CommandPublisher::setFrame(shared_ptr<Frame> frame)
+{
+    m_frame = move(frame);
+}
+
+StatusPublisher::StatusPublisher(shared_ptr<WebsocketHandler> handler, bool paused)
     : m_handler(handler)
+    , m_paused(paused)
+{
+}
+
+void StatusPublisher::run()
 {
+    m_handler->setPaused(m_paused);
 }
 
 void CommandPublisher::run()
 {
-    m_handler->publishData();
+    auto frame = move(m_frame);
+    TraceScope trace(m_handler->m_task->trace(),
+        "CommandPublisher::run",
+        frame->sequence);
+    m_handler->publishFrame(frame);
 }
 
 BaseWebsocketPublisherTask::BaseWebsocketPublisherTask(string const& name)
     : BaseWebsocketPublisherTaskBase(name)
+    , m_logger(make_shared<AsyncLogger>(Logger::Level::Debug))
+    , m_bundle_trigger([this] { trigger(); })
 {
 }
 
 BaseWebsocketPublisherTask::~BaseWebsocketPublisherTask()
 {
+    stopShards();
 }
 
 /// The following lines are template definitions for the various state machine
@@ -44,43 +121,216 @@ bool BaseWebsocketPublisherTask::configureHook()
     if (!BaseWebsocketPublisherTaskBase::configureHook())
         return false;
 
-    m_device_id_transform = "";
-    return true;
+    ServerConfiguration server_configuration;
+    server_configuration.port = _port.get();
+    server_configuration.endpoint = _endpoint.get();
+    server_configuration.shards = _shards.get();
+    server_configuration.max_clients = _max_clients.get();
+    server_configuration.client_admission_policy = _client_admission_policy.get();
+    server_configuration.trace_capacity = _trace_capacity.get();
+    if (server_configuration.shards == 0) {
+        LOG_ERROR_S << "shards must be at least 1";
+        return false;
+    }
+    if (server_configuration.port + server_configuration.shards - 1 >
+        numeric_limits<uint16_t>::max()) {
+        LOG_ERROR_S << "the port range of the " << server_configuration.shards
+                    << " shards starting at port " << server_configuration.port
+                    << " goes beyond the maximum port";
+        return false;
+    }
+    if (server_configuration.max_clients == 0) {
+        LOG_ERROR_S << "max_clients must be at least 1";
+        return false;
+    }
+    if (_input_batch_size.get() == 0) {
+        LOG_ERROR_S << "input_batch_size must be at least 1";
+        return false;
+    }
+    if (!_udp_address.get().empty() && _udp_port.get() == 0) {
+        LOG_ERROR_S << "udp_port must be set when udp_address is";
+        return false;
+    }
+    if (!_shm_name.get().empty() && _shm_capacity.get() == 0) {
+        LOG_ERROR_S << "shm_capacity must be at least 1";
+        return false;
+    }
+
+    shared_ptr<UdpPublisher> udp_publisher;
+    auto udp_address = _udp_address.get();
+    if (!udp_address.empty()) {
+        udp_publisher = make_shared<UdpPublisher>();
+        if (!udp_publisher->open(udp_address,
+                _udp_port.get(),
+                _udp_multicast_ttl.get())) {
+            return false;
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        m_udp_publisher = udp_publisher;
+        m_device_id_transform = "";
+        m_max_sample_age = _max_sample_age.get();
+        m_stale_sample_policy = _stale_sample_policy.get();
+    }
+    m_input_batch_size = _input_batch_size.get();
+    m_priority_buttons = _priority_buttons.get();
+    m_bundle_max_samples = _bundle_max_samples.get();
+    m_bundle_window = _bundle_window.get();
+    if (isBundling() && !m_bundle_window.isNull()) {
+        m_bundle_trigger.start();
+    }
+    else {
+        m_bundle_trigger.stop();
+    }
+    m_trace_path = _trace_path.get();
+    m_logger->setLevel(toSeasocksLevel(_log_level.get()));
+
+    // The servers are kept across cleanup, including the one done when going into
+    // an exception state, so that the clients stay connected when the task is
+    // recovered and started again
+    if (!m_shards.empty() &&
+        (server_configuration != m_server_configuration || !areShardsAlive())) {
+        stopShards();
+    }
+    if (m_shards.empty()) {
+        m_server_configuration = server_configuration;
+        m_trace.reset(m_server_configuration.trace_capacity);
+        if (!startShards()) {
+            return false;
+        }
+    }
+
+    // Done last, so that a failure of the steps above does not leave a new segment
+    // behind
+    return configureSharedMemory();
+}
+
+bool BaseWebsocketPublisherTask::configureSharedMemory()
+{
+    auto name = _shm_name.get();
+    auto capacity = _shm_capacity.get();
+    if (name.empty()) {
+        m_shm_writer.close();
+        return true;
+    }
+
+    // Keep the segment across reconfigurations, so that readers do not have to
+    // map it again
+    if (m_shm_writer.isOpen() && m_shm_writer.name() == name &&
+        m_shm_writer.capacity() == capacity) {
+        return true;
+    }
+    return m_shm_writer.open(name, capacity);
 }
 
 bool BaseWebsocketPublisherTask::startHook()
 {
     if (!BaseWebsocketPublisherTaskBase::startHook())
         return false;
-    m_outgoing_raw_command = {};
 
-    auto logger = make_shared<PrintfLogger>(Logger::Level::Debug);
-    m_server = make_unique<Server>(logger);
+    resetRunState();
+    notifyPaused(false);
+    return true;
+}
+
+void BaseWebsocketPublisherTask::resetRunState()
+{
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        m_outgoing_sample = {};
+        m_last_received_sequence = 0;
+        m_last_published_sequence = 0;
+        m_overwritten_samples = 0;
+        m_stale_samples = 0;
+        m_filtered_samples = 0;
+        m_priority_samples = 0;
+        m_last_priority_latency = Time();
+        m_max_priority_latency = Time();
+        m_udp_datagrams = 0;
+        m_udp_send_failures = 0;
+        m_outgoing_bundle.clear();
+        m_outgoing_bundle.reserve(m_bundle_max_samples);
+        m_outgoing_frame.reset();
+    }
+    m_deferred_publication = false;
+}
 
-    auto handler = make_shared<WebsocketHandler>(this, m_device_id_transform);
-    this->m_publisher = make_shared<CommandPublisher>(handler);
+bool BaseWebsocketPublisherTask::startShards()
+{
+    m_shard_statistics.assign(m_server_configuration.shards, ShardStatistics());
+    m_shards.resize(m_server_configuration.shards);
+    m_logger->start();
 
-    string endpoint = _endpoint.get();
-    m_server->addWebSocketHandler(endpoint.c_str(), handler, true);
+    auto const& endpoint = m_server_configuration.endpoint;
+    uint16_t port = m_server_configuration.port;
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        auto& shard = m_shards[i];
+        shard.server = make_unique<Server>(m_logger);
+        shard.handler = make_shared<WebsocketHandler>(this,
+            m_server_configuration.max_clients,
+            m_server_configuration.client_admission_policy,
+            i);
+        shard.server->addWebSocketHandler(endpoint.c_str(), shard.handler, true);
 
-    uint16_t port = _port.get();
-    if (!m_server->startListening(port)) {
-        return false;
+        if (!shard.server->startListening(port + i)) {
+            LOG_ERROR_S << "Failed to listen on port " << port + i;
+            shard.server.reset();
+            stopShards();
+            return false;
+        }
+        auto server = shard.server.get();
+        shard.thread = async(launch::async, [server] { server->loop(); });
+    }
+    return true;
+}
+
+void BaseWebsocketPublisherTask::stopShards()
+{
+    for (auto& shard : m_shards) {
+        if (shard.server) {
+            shard.server->terminate();
+        }
+    }
+    for (auto& shard : m_shards) {
+        if (shard.thread.valid()) {
+            shard.thread.wait();
+        }
+    }
+    m_shards.clear();
+    m_frame_pool.clear();
+    m_logger->stop();
+}
+
+bool BaseWebsocketPublisherTask::areShardsAlive() const
+{
+    for (auto const& shard : m_shards) {
+        if (shard.thread.wait_for(0ms) == future_status::ready) {
+            return false;
+        }
     }
-    m_server_thread = async(launch::async, [this] { this->m_server->loop(); });
     return true;
 }
 
+void BaseWebsocketPublisherTask::notifyPaused(bool paused)
+{
+    for (auto const& shard : m_shards) {
+        shard.server->execute(make_shared<StatusPublisher>(shard.handler, paused));
+    }
+}
+
 void BaseWebsocketPublisherTask::updateHook()
 {
     BaseWebsocketPublisherTaskBase::updateHook();
 
-    auto status = m_server_thread.wait_for(0ms);
-
-    if (status == std::future_status::ready) {
+    if (!areShardsAlive()) {
         LOG_ERROR_S << "Server thread unexpectedly terminated" << std::endl;
         exception();
+        return;
     }
+
+    flushExpiredBundle();
 }
 
 void BaseWebsocketPublisherTask::errorHook()
@@ -92,34 +342,351 @@ void BaseWebsocketPublisherTask::stopHook()
 {
     BaseWebsocketPublisherTaskBase::stopHook();
 
-    m_server->terminate();
-    m_server_thread.wait();
+    notifyPaused(true);
+
+    if (!m_trace_path.empty() && !dumpTrace(m_trace_path)) {
+        LOG_ERROR_S << "Failed to write the pipeline trace to " << m_trace_path;
+    }
 }
 
 void BaseWebsocketPublisherTask::cleanupHook()
 {
     BaseWebsocketPublisherTaskBase::cleanupHook();
+    m_bundle_trigger.stop();
+}
+
+bool BaseWebsocketPublisherTask::ServerConfiguration::operator==(
+    ServerConfiguration const& other) const
+{
+    return port == other.port && endpoint == other.endpoint &&
+           shards == other.shards && max_clients == other.max_clients &&
+           client_admission_policy == other.client_admission_policy &&
+           trace_capacity == other.trace_capacity;
+}
+
+bool BaseWebsocketPublisherTask::ServerConfiguration::operator!=(
+    ServerConfiguration const& other) const
+{
+    return !(*this == other);
 }
 
-void BaseWebsocketPublisherTask::outputStatistics(vector<Client> const& active_clients)
+void BaseWebsocketPublisherTask::outputStatistics(size_t shard,
+    ClientPool const& clients,
+    uint64_t skipped_frames)
 {
+    lock_guard<mutex> statistics_lock(m_statistics_lock);
+    auto& shard_stats = m_shard_statistics.at(shard);
+    shard_stats.sockets.clear();
+    for (auto const& client : clients) {
+        if (client.active) {
+            shard_stats.sockets.push_back(client.statistics);
+        }
+    }
+    shard_stats.rejected = clients.rejected();
+    shard_stats.evicted = clients.evicted();
+    shard_stats.skipped_frames = skipped_frames;
+
     Statistics stats;
     stats.time = Time::now();
-    for (auto const& socket : active_clients) {
-        stats.sockets_statistics.push_back(socket.statistics);
+    for (auto const& other_shard_stats : m_shard_statistics) {
+        stats.sockets_statistics.insert(stats.sockets_statistics.end(),
+            other_shard_stats.sockets.begin(),
+            other_shard_stats.sockets.end());
+        stats.rejected_clients += other_shard_stats.rejected;
+        stats.evicted_clients += other_shard_stats.evicted;
+        stats.skipped_frames.push_back(other_shard_stats.skipped_frames);
+    }
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        stats.received_samples = m_last_received_sequence;
+        stats.overwritten_samples = m_overwritten_samples;
+        stats.last_published_sequence = m_last_published_sequence;
+        stats.stale_samples = m_stale_samples;
+        stats.filtered_samples = m_filtered_samples;
+        stats.priority_samples = m_priority_samples;
+        stats.last_priority_latency = m_last_priority_latency;
+        stats.max_priority_latency = m_max_priority_latency;
+        stats.udp_datagrams = m_udp_datagrams;
+        stats.udp_send_failures = m_udp_send_failures;
     }
     _statistics.write(stats);
 }
 
 void BaseWebsocketPublisherTask::publishRawCommand()
 {
-    m_server->execute(m_publisher);
+    if (!isBundling()) {
+        queueFrame();
+        return;
+    }
+
+    bool full = false;
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        if (!m_outgoing_sample.has_value()) {
+            return;
+        }
+        if (m_outgoing_bundle.empty()) {
+            m_bundle_started_at = Time::now();
+            if (!m_bundle_window.isNull()) {
+                m_bundle_trigger.arm(m_bundle_started_at + m_bundle_window);
+            }
+        }
+        m_outgoing_bundle.push_back(m_outgoing_sample.value());
+        // Priority samples flush the bundle they are part of
+        full = m_outgoing_bundle.size() >= m_bundle_max_samples ||
+               m_outgoing_sample->priority;
+    }
+
+    if (full) {
+        queueFrame();
+    }
+    else {
+        flushExpiredBundle();
+    }
+}
+
+void BaseWebsocketPublisherTask::publishBatchedRawCommand()
+{
+    if (m_deferred_publication) {
+        // The deferred sample was replaced by the new one without being published
+        lock_guard<mutex> lock(m_shared_data_lock);
+        m_overwritten_samples++;
+    }
+    if (m_input_batch_size > 1 && !isBundling()) {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        if (m_outgoing_sample.has_value() && !m_outgoing_sample->priority) {
+            m_deferred_publication = true;
+            return;
+        }
+    }
+    m_deferred_publication = false;
+    publishRawCommand();
+}
+
+void BaseWebsocketPublisherTask::publishDeferredRawCommand()
+{
+    if (!m_deferred_publication) {
+        return;
+    }
+    m_deferred_publication = false;
+    publishRawCommand();
+}
+
+void BaseWebsocketPublisherTask::flushExpiredBundle()
+{
+    if (!isBundling() || m_bundle_window.isNull()) {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        if (m_outgoing_bundle.empty() ||
+            Time::now() - m_bundle_started_at < m_bundle_window) {
+            return;
+        }
+    }
+    queueFrame();
+}
+
+void BaseWebsocketPublisherTask::queueFrame()
+{
+    // Frames and publishers are reused, so that publishing does not allocate as
+    // long as the pools cover the backlog of the shards
+    auto frame = acquireFromPool(m_frame_pool, POOL_SIZE_PER_SHARD * m_shards.size());
+    frame->bundle = isBundling();
+    frame->claimed = false;
+    frame->encoded = false;
+    frame->payload.clear();
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        if (frame->bundle) {
+            swap(frame->samples, m_outgoing_bundle);
+            m_outgoing_bundle.clear();
+            m_outgoing_bundle.reserve(m_bundle_max_samples);
+        }
+        else if (m_outgoing_sample.has_value()) {
+            // Assigning to an existing sample reuses its buffers
+            frame->samples.resize(1);
+            frame->samples[0] = m_outgoing_sample.value();
+        }
+        else {
+            frame->samples.clear();
+        }
+        if (frame->samples.empty()) {
+            return;
+        }
+        frame->sequence = frame->samples.back().sequence;
+        frame->priority = frame->samples.back().priority;
+        if (frame->priority) {
+            m_priority_samples++;
+        }
+
+        if (m_outgoing_frame && !m_outgoing_frame->bundle &&
+            !m_outgoing_frame->priority && !m_outgoing_frame->claimed) {
+            m_overwritten_samples++;
+        }
+        m_outgoing_frame = frame;
+    }
+
+    for (auto& shard : m_shards) {
+        TraceScope trace(m_trace, "Server::execute", frame->sequence);
+        auto publisher = acquireFromPool(shard.publishers,
+            POOL_SIZE_PER_SHARD,
+            shard.handler);
+        publisher->setFrame(frame);
+        shard.server->execute(publisher);
+    }
+}
+
+bool BaseWebsocketPublisherTask::claimFrame(Frame& frame)
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    if (!frame.bundle && !frame.priority && m_outgoing_frame.get() != &frame) {
+        return false;
+    }
+    frame.claimed = true;
+    return true;
+}
+
+bool BaseWebsocketPublisherTask::isSuperseded(Frame const& frame)
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    return m_outgoing_frame.get() != &frame;
+}
+
+bool BaseWebsocketPublisherTask::isBundling() const
+{
+    return m_bundle_max_samples != 0;
 }
 
 optional<controldev::RawCommand> BaseWebsocketPublisherTask::outgoingRawCommand()
 {
+    auto lock_start = m_trace.now();
+    lock_guard<mutex> lock(m_shared_data_lock);
+    m_trace.record("outgoingRawCommand lock", lock_start);
+    if (!m_outgoing_sample.has_value()) {
+        return {};
+    }
+    return m_outgoing_sample->raw_command;
+}
+
+optional<Sample> BaseWebsocketPublisherTask::outgoingSample()
+{
+    auto lock_start = m_trace.now();
     lock_guard<mutex> lock(m_shared_data_lock);
-    return m_outgoing_raw_command;
+    m_trace.record("outgoingSample lock", lock_start);
+    return m_outgoing_sample;
+}
+
+void BaseWebsocketPublisherTask::setOutgoingRawCommand(
+    controldev::RawCommand const& raw_command,
+    bool priority)
+{
+    Sample sample;
+    sample.sequence = ++m_last_received_sequence;
+    sample.raw_command = raw_command;
+    sample.priority = priority;
+    if (priority) {
+        sample.received_at = Time::now();
+    }
+    if (m_shm_writer.isOpen()) {
+        m_shm_writer.write(sample);
+    }
+    m_outgoing_sample = sample;
+}
+
+bool BaseWebsocketPublisherTask::changesPriorityButtons(
+    controldev::RawCommand const& raw_command) const
+{
+    if (!m_outgoing_sample.has_value()) {
+        return false;
+    }
+
+    auto const& previous = m_outgoing_sample->raw_command.buttonValue;
+    auto const& current = raw_command.buttonValue;
+    for (auto index : m_priority_buttons) {
+        bool has_previous = index < previous.size();
+        bool has_current = index < current.size();
+        if (has_previous != has_current) {
+            return true;
+        }
+        if (has_current && previous[index] != current[index]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BaseWebsocketPublisherTask::priorityPublished(Time const& received_at)
+{
+    auto latency = Time::now() - received_at;
+    lock_guard<mutex> lock(m_shared_data_lock);
+    m_last_priority_latency = latency;
+    m_max_priority_latency = max(m_max_priority_latency, latency);
+}
+
+void BaseWebsocketPublisherTask::samplePublished(uint64_t sequence)
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    m_last_published_sequence = max(m_last_published_sequence, sequence);
+}
+
+Time BaseWebsocketPublisherTask::maxSampleAge()
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    return m_max_sample_age;
+}
+
+StaleSamplePolicy BaseWebsocketPublisherTask::staleSamplePolicy()
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    return m_stale_sample_policy;
+}
+
+void BaseWebsocketPublisherTask::sendDatagram(string const& payload)
+{
+    shared_ptr<UdpPublisher> udp_publisher;
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        udp_publisher = m_udp_publisher;
+    }
+    if (!udp_publisher) {
+        return;
+    }
+
+    bool sent = udp_publisher->send(payload);
+    lock_guard<mutex> lock(m_shared_data_lock);
+    if (sent) {
+        m_udp_datagrams++;
+    }
+    else {
+        m_udp_send_failures++;
+    }
+}
+
+void BaseWebsocketPublisherTask::countStaleSamples(uint64_t count)
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    m_stale_samples += count;
+}
+
+Trace& BaseWebsocketPublisherTask::trace()
+{
+    return m_trace;
+}
+
+AsyncLogger& BaseWebsocketPublisherTask::logger()
+{
+    return *m_logger;
+}
+
+bool BaseWebsocketPublisherTask::dumpTrace(string const& path)
+{
+    if (!m_trace.isEnabled()) {
+        LOG_ERROR_S << "Cannot dump the pipeline trace, tracing is disabled";
+        return false;
+    }
+    return m_trace.dump(path);
 }
 
 optional<string> BaseWebsocketPublisherTask::deviceIdentifier()
@@ -128,6 +695,12 @@ optional<string> BaseWebsocketPublisherTask::deviceIdentifier()
     return m_device_identifier;
 }
 
+string BaseWebsocketPublisherTask::deviceIdTransform()
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    return m_device_id_transform;
+}
+
 bool BaseWebsocketPublisherTask::validateDeviceIdTransform(string const& transform_str)
 {
     const string token = "%1";
@@ -3,7 +3,12 @@
 #ifndef GAMEPAD_WEBSOCKET_BASEWEBSOCKETPUBLISHERTASK_TASK_HPP
 #define GAMEPAD_WEBSOCKET_BASEWEBSOCKETPUBLISHERTASK_TASK_HPP
 
-#include "Client.hpp"
+#include "ClientPool.hpp"
+#include "DeadlineTrigger.hpp"
+#include "Frame.hpp"
+#include "Sample.hpp"
+#include "SharedMemoryWriter.hpp"
+#include "Trace.hpp"
 #include "controldev/RawCommand.hpp"
 #include "gamepad_websocket/BaseWebsocketPublisherTaskBase.hpp"
 
@@ -15,6 +20,8 @@
 
 namespace gamepad_websocket {
     // Forward declaration to avoid circular includes
+    class AsyncLogger;
+    class UdpPublisher;
     class WebsocketHandler;
 
     /**
@@ -25,13 +32,48 @@ namespace gamepad_websocket {
     class CommandPublisher : public seasocks::Server::Runnable {
     private:
         std::shared_ptr<WebsocketHandler> m_handler;
+        std::shared_ptr<Frame> m_frame;
 
     public:
-        CommandPublisher(std::shared_ptr<WebsocketHandler> handler);
+        CommandPublisher(std::shared_ptr<WebsocketHandler> handler,
+            std::shared_ptr<Frame> frame = nullptr);
+
+        /*
+         * Sets the frame published by the next run. The frame is released once
+         * published, so that publishers and frames can be reused.
+         */
+        void setFrame(std::shared_ptr<Frame> frame);
+
+        void run() override;
+    };
+
+    /**
+     * Runs WebsocketHandler::setPaused in the server thread
+     */
+    class StatusPublisher : public seasocks::Server::Runnable {
+    private:
+        std::shared_ptr<WebsocketHandler> m_handler;
+        bool m_paused;
+
+    public:
+        StatusPublisher(std::shared_ptr<WebsocketHandler> handler, bool paused);
 
         void run() override;
     };
 
+    /**
+     * A websocket server with its own event loop thread, serving a part of the
+     * clients of the task
+     */
+    struct Shard {
+        std::unique_ptr<seasocks::Server> server;
+        std::future<void> thread;
+        std::shared_ptr<WebsocketHandler> handler;
+        /* Publishers handed to the server, reused once it ran them. Holds at most
+         * POOL_SIZE_PER_SHARD publishers */
+        std::vector<std::shared_ptr<CommandPublisher>> publishers;
+    };
+
     /*! \class BaseWebsocketPublisherTask
      * \brief The task context provides and requires services. It uses an ExecutionEngine
      to perform its functions.
@@ -54,23 +96,174 @@ namespace gamepad_websocket {
         friend class BaseWebsocketPublisherTaskBase;
 
     protected:
-        std::unique_ptr<seasocks::Server> m_server;
-        std::future<void> m_server_thread;
-        std::shared_ptr<CommandPublisher> m_publisher;
+        /*
+         * The settings the shards are created with. The shards are kept across
+         * cleanup and configure as long as these settings do not change.
+         */
+        struct ServerConfiguration {
+            uint16_t port = 0;
+            std::string endpoint;
+            uint32_t shards = 1;
+            uint32_t max_clients = 0;
+            ClientAdmissionPolicy client_admission_policy = REJECT_NEW_CLIENTS;
+            uint32_t trace_capacity = 0;
+
+            bool operator==(ServerConfiguration const& other) const;
+            bool operator!=(ServerConfiguration const& other) const;
+        };
+
+        /* Logger of the servers and of their handlers, shared by all the shards */
+        std::shared_ptr<AsyncLogger> m_logger;
+        std::vector<Shard> m_shards;
+        ServerConfiguration m_server_configuration;
         std::optional<std::string> m_device_identifier;
-        std::optional<controldev::RawCommand> m_outgoing_raw_command;
+        std::optional<Sample> m_outgoing_sample;
         std::string m_device_id_transform = "";
 
+        /* Sequence number of the last received sample, which is also their count */
+        uint64_t m_last_received_sequence = 0;
+        uint64_t m_last_published_sequence = 0;
+        uint64_t m_overwritten_samples = 0;
+        uint64_t m_stale_samples = 0;
+        /* Samples a subclass decided not to publish, see Statistics */
+        uint64_t m_filtered_samples = 0;
+
+        /* Indexes of the buttons whose changes are published right away */
+        std::vector<uint32_t> m_priority_buttons;
+        uint64_t m_priority_samples = 0;
+        base::Time m_last_priority_latency;
+        base::Time m_max_priority_latency;
+
+        base::Time m_max_sample_age;
+        StaleSamplePolicy m_stale_sample_policy = DROP_STALE_SAMPLES;
+
+        uint32_t m_bundle_max_samples = 0;
+        base::Time m_bundle_window;
+        /* Samples waiting to be sent as a single frame, when bundling is enabled */
+        std::vector<Sample> m_outgoing_bundle;
+        /* Time at which the first sample of m_outgoing_bundle was queued */
+        base::Time m_bundle_started_at;
+        /* Triggers the task when the bundle window expires, so that the bundle is
+         * sent even if no new input comes */
+        DeadlineTrigger m_bundle_trigger;
+
+        /* Maximum number of samples a subclass reads from its input port in a
+         * single updateHook */
+        uint32_t m_input_batch_size = 1;
+        /* Whether the outgoing sample is waiting for publishDeferredRawCommand */
+        bool m_deferred_publication = false;
+
+        /* The last frame handed to the shards */
+        std::shared_ptr<Frame> m_outgoing_frame;
+        /* Frames handed to the shards, reused once they are all done with them.
+         * Holds at most POOL_SIZE_PER_SHARD frames per shard */
+        std::vector<std::shared_ptr<Frame>> m_frame_pool;
+
+        /* Sends the encoded frames as datagrams, if udp_address is set */
+        std::shared_ptr<UdpPublisher> m_udp_publisher;
+        uint64_t m_udp_datagrams = 0;
+        uint64_t m_udp_send_failures = 0;
+
+        /* Writes the outgoing samples in shared memory, if shm_name is set. Only
+         * used by the task thread */
+        SharedMemoryWriter m_shm_writer;
+
         std::mutex m_shared_data_lock;
 
+        Trace m_trace;
+        std::string m_trace_path;
+
+        /* The statistics of the clients of a shard, as last reported by it */
+        struct ShardStatistics {
+            std::vector<SocketStatistics> sockets;
+            uint64_t rejected = 0;
+            uint64_t evicted = 0;
+            uint64_t skipped_frames = 0;
+        };
+        std::vector<ShardStatistics> m_shard_statistics;
+        std::mutex m_statistics_lock;
+
         /*
-         * Requests that the server thread executes the current CommandPublisher
-         * in the next cycle.
+         * Gives the next sequence number to the given raw command and makes it the
+         * outgoing sample, which is also written in shared memory if enabled. Must
+         * be called with m_shared_data_lock held.
+         *
+         * \param priority whether the sample must be published right away, see
+         *   changesPriorityButtons
+         */
+        void setOutgoingRawCommand(controldev::RawCommand const& raw_command,
+            bool priority = false);
+
+        /*
+         * Whether the given raw command changes any of the priority buttons with
+         * respect to the outgoing sample. Must be called with m_shared_data_lock
+         * held.
+         */
+        bool changesPriorityButtons(controldev::RawCommand const& raw_command) const;
+
+        /*
+         * Requests that the server threads publish the current outgoing sample in
+         * their next cycle. When bundling, the sample is queued instead, and the
+         * bundle is published once full or expired, or right away if the sample is
+         * a priority sample.
          */
         void publishRawCommand();
 
+        /*
+         * Publishes the outgoing sample while a batch of input samples is being
+         * processed.
+         *
+         * When the sample may be replaced by a newer one of the same batch, it is
+         * left for publishDeferredRawCommand instead, so that a batch is published
+         * in a single frame. Bundled samples and priority samples are always
+         * published right away, so that none of them is lost.
+         */
+        void publishBatchedRawCommand();
+
+        /*
+         * Publishes the outgoing sample left by publishBatchedRawCommand, if any.
+         * Called once the whole batch is processed.
+         */
+        void publishDeferredRawCommand();
+
+        /*
+         * Requests the server threads to send the current bundle if its window
+         * expired. Does nothing when bundling is disabled.
+         */
+        void flushExpiredBundle();
+
+        /*
+         * Makes a frame out of the current outgoing sample, or out of the queued
+         * samples when bundling, and hands it to all the shards
+         */
+        void queueFrame();
+
+        bool configureSharedMemory();
+
+        bool startShards();
+        void stopShards();
+        bool areShardsAlive() const;
+
+        /*
+         * Tells the clients of all the shards that the task stopped or started
+         */
+        void notifyPaused(bool paused);
+
+        /*
+         * Resets the state of the previous run. Called by startHook before the
+         * clients are told that the task resumed, so that the server threads only
+         * ever see the state of the new run. Overloads must call this one.
+         */
+        virtual void resetRunState();
+
         bool validateDeviceIdTransform(std::string const& transform_str);
 
+        /*
+         * Writes the pipeline trace to the given file, in the Chrome trace event
+         * format
+         */
+        bool dumpTrace(std::string const& path);
+
     public:
         /*
          * Returns the latest outgoing raw command to be published to all the
@@ -78,15 +271,92 @@ namespace gamepad_websocket {
          */
         std::optional<controldev::RawCommand> outgoingRawCommand();
 
+        /*
+         * Returns the latest outgoing sample, if there is one.
+         */
+        std::optional<Sample> outgoingSample();
+
+        /*
+         * Records that the sample with the given sequence number has been sent to
+         * the clients.
+         */
+        void samplePublished(uint64_t sequence);
+
+        /*
+         * Marks the given frame as being encoded. Returns false if the frame holds a
+         * single sample that was superseded by a newer frame before any shard could
+         * publish it, in which case it should not be published.
+         *
+         * Superseded frames that were never claimed are counted as overwritten.
+         */
+        bool claimFrame(Frame& frame);
+
+        /*
+         * Whether a frame newer than the given one has been handed to the shards
+         */
+        bool isSuperseded(Frame const& frame);
+
+        /*
+         * Maximum age of the samples when they are sent. Zero if there is none.
+         */
+        base::Time maxSampleAge();
+
+        StaleSamplePolicy staleSamplePolicy();
+
+        /*
+         * Records that a priority sample received at the given time has been
+         * handed to the clients of a shard
+         */
+        void priorityPublished(base::Time const& received_at);
+
+        /*
+         * Sends the given encoded frame on the UDP side channel, if there is one
+         */
+        void sendDatagram(std::string const& payload);
+
+        /*
+         * Adds the given count to the count of stale samples
+         */
+        void countStaleSamples(uint64_t count);
+
+        /*
+         * Whether samples are published in bundles instead of one frame each
+         */
+        bool isBundling() const;
+
         std::optional<std::string> deviceIdentifier();
+
+        /*
+         * The transform applied to the device identifier before it is sent to the
+         * clients. See the device_identifier_transform property.
+         */
+        std::string deviceIdTransform();
+
+        /*
+         * The pipeline trace, to which the server threads add their events
+         */
+        Trace& trace();
+
+        /*
+         * The logger of the servers. Handlers log through it instead of
+         * base-logging, so that they never block on writing the messages
+         */
+        AsyncLogger& logger();
+
         /*
-         * Take a list of the active clients statistics and write it in the
-         * statistics port. This is called in the server thread by the
+         * Take the statistics of the active clients of the pool and write them in
+         * the statistics port, alongside the ones last reported by the other
+         * shards. This is called in the server threads by the
          * seasocks::WebSocket::Handler to write only when the statistics change.
          *
-         * \param active_clients The clients that are currently active.
+         * \param shard The index of the shard the clients belong to
+         * \param clients The clients of the handler. Pending ones are ignored.
+         * \param skipped_frames The count of frames the shard did not send because
+         *   they were superseded
          */
-        void outputStatistics(std::vector<Client> const& active_clients);
+        void outputStatistics(size_t shard,
+            ClientPool const& clients,
+            uint64_t skipped_frames);
 
         /** TaskContext constructor for BaseWebsocketPublisherTask
          * \param name Name of the task. This name needs to be unique to make it
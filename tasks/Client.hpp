@@ -11,8 +11,13 @@ namespace gamepad_websocket {
      * statistics of that connection.
      */
     struct Client {
-        seasocks::WebSocket* connection;
+        seasocks::WebSocket* connection = nullptr;
         SocketStatistics statistics;
+        /* Time at which the connection was accepted */
+        base::Time connected_at;
+        /* Whether the client got the handshake and receives the published samples.
+         * Clients stay pending until the device identifier is known. */
+        bool active = false;
     };
 }
 
@@ -0,0 +1,117 @@
+#include "ClientPool.hpp"
+
+#include <algorithm>
+
+using namespace base;
+using namespace gamepad_websocket;
+using namespace seasocks;
+using namespace std;
+
+ClientPool::ClientPool(size_t capacity)
+    : m_capacity(capacity)
+{
+    m_clients.reserve(capacity);
+}
+
+ClientPool::Admission ClientPool::admit(WebSocket* socket, ClientAdmissionPolicy policy)
+{
+    Admission admission;
+    if (full()) {
+        auto oldest_client = oldest();
+        if (policy != EVICT_OLDEST_CLIENT || oldest_client == nullptr) {
+            m_rejected++;
+            return admission;
+        }
+
+        admission.evicted = oldest_client->connection;
+        remove(admission.evicted);
+        m_evicted++;
+    }
+
+    Client client;
+    client.connection = socket;
+    client.connected_at = Time::now();
+    m_clients.push_back(client);
+    admission.client = &m_clients.back();
+    return admission;
+}
+
+bool ClientPool::remove(WebSocket* socket)
+{
+    auto client_it = find_if(m_clients.begin(),
+        m_clients.end(),
+        [socket](Client const& client) { return client.connection == socket; });
+    if (client_it == m_clients.end()) {
+        return false;
+    }
+
+    *client_it = m_clients.back();
+    m_clients.pop_back();
+    return true;
+}
+
+Client* ClientPool::find(WebSocket* socket)
+{
+    for (auto& client : m_clients) {
+        if (client.connection == socket) {
+            return &client;
+        }
+    }
+    return nullptr;
+}
+
+Client* ClientPool::oldest()
+{
+    auto client_it = min_element(m_clients.begin(),
+        m_clients.end(),
+        [](Client const& a, Client const& b) { return a.connected_at < b.connected_at; });
+    if (client_it == m_clients.end()) {
+        return nullptr;
+    }
+    return &(*client_it);
+}
+
+size_t ClientPool::size() const
+{
+    return m_clients.size();
+}
+
+size_t ClientPool::capacity() const
+{
+    return m_capacity;
+}
+
+bool ClientPool::full() const
+{
+    return m_clients.size() >= m_capacity;
+}
+
+uint64_t ClientPool::rejected() const
+{
+    return m_rejected;
+}
+
+uint64_t ClientPool::evicted() const
+{
+    return m_evicted;
+}
+
+vector<Client>::iterator ClientPool::begin()
+{
+    return m_clients.begin();
+}
+
+vector<Client>::iterator ClientPool::end()
+{
+    return m_clients.end();
+}
+
+vector<Client>::const_iterator ClientPool::begin() const
+{
+    return m_clients.begin();
+}
+
+vector<Client>::const_iterator ClientPool::end() const
+{
+    return m_clients.end();
+}
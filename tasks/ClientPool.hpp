@@ -0,0 +1,76 @@
+#ifndef GAMEPAD_WEBSOCKET_CLIENTPOOL_HPP
+#define GAMEPAD_WEBSOCKET_CLIENTPOOL_HPP
+
+#include "Client.hpp"
+#include "gamepad_websocketTypes.hpp"
+
+#include <cstdint>
+#include <seasocks/WebSocket.h>
+#include <vector>
+
+namespace gamepad_websocket {
+    /*
+     * Fixed-capacity storage for the clients of a websocket handler.
+     *
+     * The storage is allocated once at construction. Removing a client moves the
+     * last one in its slot, so clients are not kept in connection order.
+     */
+    class ClientPool {
+        std::vector<Client> m_clients;
+        size_t m_capacity = 0;
+        uint64_t m_rejected = 0;
+        uint64_t m_evicted = 0;
+
+        Client* oldest();
+
+    public:
+        /*
+         * Outcome of the admission of a new connection
+         */
+        struct Admission {
+            /* The client created for the new connection, or nullptr if the
+             * connection was rejected */
+            Client* client = nullptr;
+            /* The connection removed to make room for the new one, if any. It is up
+             * to the caller to close it. */
+            seasocks::WebSocket* evicted = nullptr;
+        };
+
+        explicit ClientPool(size_t capacity = 0);
+
+        /*
+         * Tries to add a client for the given connection, applying the given policy
+         * when the pool is full. The returned client pointer is valid until the next
+         * change to the pool.
+         */
+        Admission admit(seasocks::WebSocket* socket, ClientAdmissionPolicy policy);
+
+        /*
+         * Removes the client of the given connection. Returns false if there was
+         * none.
+         */
+        bool remove(seasocks::WebSocket* socket);
+
+        /*
+         * Returns the client of the given connection, or nullptr if there is none.
+         * The pointer is valid until the next change to the pool.
+         */
+        Client* find(seasocks::WebSocket* socket);
+
+        size_t size() const;
+        size_t capacity() const;
+        bool full() const;
+
+        /* Count of connections rejected by #admit */
+        uint64_t rejected() const;
+        /* Count of connections evicted by #admit */
+        uint64_t evicted() const;
+
+        std::vector<Client>::iterator begin();
+        std::vector<Client>::iterator end();
+        std::vector<Client>::const_iterator begin() const;
+        std::vector<Client>::const_iterator end() const;
+    };
+}
+
+#endif
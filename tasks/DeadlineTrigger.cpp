@@ -0,0 +1,76 @@
+#include "DeadlineTrigger.hpp"
+
+#include <chrono>
+
+using namespace base;
+using namespace gamepad_websocket;
+using namespace std;
+
+static chrono::system_clock::time_point toTimePoint(Time const& time)
+{
+    return chrono::system_clock::time_point(
+        chrono::microseconds(time.toMicroseconds()));
+}
+
+DeadlineTrigger::DeadlineTrigger(function<void()> callback)
+    : m_callback(move(callback))
+{
+}
+
+DeadlineTrigger::~DeadlineTrigger()
+{
+    stop();
+}
+
+void DeadlineTrigger::start()
+{
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_quit = false;
+    m_thread = thread([this] { run(); });
+}
+
+void DeadlineTrigger::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_quit = true;
+        m_armed = false;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void DeadlineTrigger::arm(Time const& deadline)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_deadline = deadline;
+        m_armed = true;
+    }
+    m_condition.notify_one();
+}
+
+void DeadlineTrigger::run()
+{
+    unique_lock<mutex> lock(m_mutex);
+    while (!m_quit) {
+        if (!m_armed) {
+            m_condition.wait(lock);
+            continue;
+        }
+        if (Time::now() < m_deadline) {
+            m_condition.wait_until(lock, toTimePoint(m_deadline));
+            continue;
+        }
+
+        m_armed = false;
+        lock.unlock();
+        m_callback();
+        lock.lock();
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef GAMEPAD_WEBSOCKET_DEADLINETRIGGER_HPP
+#define GAMEPAD_WEBSOCKET_DEADLINETRIGGER_HPP
+
+#include "base/Time.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace gamepad_websocket {
+    /*
+     * Calls a function from a thread of its own once a deadline is reached.
+     *
+     * The task is otherwise only triggered by new input and by its timeout. This
+     * wakes it up when something it holds, e.g. a bundle, must be sent at a given
+     * time. The thread sleeps on a condition variable while no deadline is set.
+     */
+    class DeadlineTrigger {
+    public:
+        explicit DeadlineTrigger(std::function<void()> callback);
+
+        /*
+         * Stops the thread, without calling the function for a pending deadline
+         */
+        ~DeadlineTrigger();
+
+        DeadlineTrigger(DeadlineTrigger const&) = delete;
+        DeadlineTrigger& operator=(DeadlineTrigger const&) = delete;
+
+        /*
+         * Starts the thread. Does nothing if it is already running
+         */
+        void start();
+
+        /*
+         * Stops the thread and forgets the pending deadline. Does nothing if it is
+         * not running
+         */
+        void stop();
+
+        /*
+         * Calls the function once the given time is reached, replacing the pending
+         * deadline if there is one
+         */
+        void arm(base::Time const& deadline);
+
+    private:
+        std::function<void()> m_callback;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        base::Time m_deadline;
+        bool m_armed = false;
+        bool m_quit = false;
+        std::thread m_thread;
+
+        void run();
+    };
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef GAMEPAD_WEBSOCKET_FRAME_HPP
+#define GAMEPAD_WEBSOCKET_FRAME_HPP
+
+#include "Sample.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gamepad_websocket {
+    /*
+     * Samples published as a single websocket message to the clients of all the
+     * server shards.
+     *
+     * The samples are not modified once the frame is handed to the shards. The
+     * message is encoded once, by the first shard that publishes the frame, and
+     * the other shards send the same bytes.
+     *
+     * Frames are pooled by the task, and reused once no shard refers to them
+     * anymore.
+     */
+    struct Frame {
+        /* Sequence number of the newest sample of the frame */
+        uint64_t sequence = 0;
+        /* Whether the samples are sent as a bundle. Otherwise, the frame holds a
+         * single sample. */
+        bool bundle = false;
+        /* Whether the newest sample is a priority sample. Priority frames are
+         * published even if a newer frame was queued in the meantime. */
+        bool priority = false;
+        std::vector<Sample> samples;
+
+        /* Set by the task when a shard starts encoding the frame */
+        bool claimed = false;
+        /* Held by the shard that encodes the frame, while the others wait for it */
+        std::mutex encoding;
+        /* Whether payload is up to date, guarded by encoding */
+        bool encoded = false;
+        /* The encoded message. Empty if there is nothing to send. */
+        std::string payload;
+    };
+}
+
+#endif
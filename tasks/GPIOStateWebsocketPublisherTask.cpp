@@ -25,7 +25,19 @@ bool GPIOStateWebsocketPublisherTask::configureHook()
 {
     if (!GPIOStateWebsocketPublisherTaskBase::configureHook())
         return false;
-    m_device_identifier = _device_identifier.get();
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        m_device_identifier = _device_identifier.get();
+    }
+    m_debounce_windows = _debounce_window.get();
+    for (auto const& window : m_debounce_windows) {
+        if (window < Time()) {
+            LOG_ERROR_S << "debounce_window must be positive or zero";
+            return false;
+        }
+    }
+    m_refresh_period = _refresh_period.get();
+    m_debouncer = PinDebouncer(m_debounce_windows, m_priority_buttons);
     return true;
 }
 
@@ -36,21 +48,60 @@ bool GPIOStateWebsocketPublisherTask::startHook()
     return true;
 }
 
+void GPIOStateWebsocketPublisherTask::resetRunState()
+{
+    GPIOStateWebsocketPublisherTaskBase::resetRunState();
+    m_debouncer.reset();
+    m_last_publication = Time();
+}
+
 void GPIOStateWebsocketPublisherTask::updateHook()
 {
     GPIOStateWebsocketPublisherTaskBase::updateHook();
 
     GPIOState gpio_state;
-    if (_gpio_state.read(gpio_state) != RTT::NewData) {
-        return;
-    }
+    auto now = Time::now();
+    bool has_new_data = false;
+    bool published = false;
+    for (uint32_t i = 0; i < m_input_batch_size; ++i) {
+        auto read_start = m_trace.now();
+        if (_gpio_state.read(gpio_state) != RTT::NewData) {
+            break;
+        }
+        m_trace.record("gpio_state read", read_start);
+        has_new_data = true;
 
-    updateOutgoingRawCommand(gpio_state);
+        if (!validateStateSize(gpio_state)) {
+            publishDeferredRawCommand();
+            exception(SIZE_MISMATCH);
+            return;
+        }
+        bool transition = m_debouncer.update(gpio_state, now);
+        if (!m_debouncer.isEnabled()) {
+            // Without debouncing, every sample is published at the time it is
+            // received
+            publish(now, now);
+            published = true;
+        }
+        else if (transition) {
+            publish(m_debouncer.lastTransition(), now);
+            published = true;
+        }
+        else {
+            lock_guard<mutex> lock(m_shared_data_lock);
+            m_filtered_samples++;
+        }
+    }
 
-    if (state() != PUBLISHING) {
-        state(PUBLISHING);
+    if (!published) {
+        if (!has_new_data && m_debouncer.poll(now)) {
+            publish(m_debouncer.lastTransition(), now);
+        }
+        else if (isRefreshDue(now)) {
+            publish(now, now);
+        }
     }
-    publishRawCommand();
+    publishDeferredRawCommand();
 }
 
 void GPIOStateWebsocketPublisherTask::errorHook()
@@ -68,28 +119,56 @@ void GPIOStateWebsocketPublisherTask::cleanupHook()
     GPIOStateWebsocketPublisherTaskBase::cleanupHook();
 }
 
-void GPIOStateWebsocketPublisherTask::updateOutgoingRawCommand(
-    GPIOState const& gpio_state)
+bool GPIOStateWebsocketPublisherTask::validateStateSize(GPIOState const& gpio_state)
 {
     auto const& state_size = gpio_state.states.size();
+    if (m_debounce_windows.size() > 1 && m_debounce_windows.size() != state_size) {
+        LOG_ERROR_S << "debounce_window has " << m_debounce_windows.size()
+                    << " elements, but got a GPIOState with " << state_size
+                    << " elements";
+        return false;
+    }
+
     auto previous_outgoing_raw_command = outgoingRawCommand();
-    if (previous_outgoing_raw_command.has_value()) {
-        auto last_gpio_state_size = previous_outgoing_raw_command.value().buttonValue.size();
-        if (last_gpio_state_size != 0 && last_gpio_state_size != state_size) {
-            LOG_ERROR_S << "Expected a GPIOState with " << last_gpio_state_size
-                        << " elements, but got one with " << state_size << " elements";
-            exception(SIZE_MISMATCH);
-            return;
-        }
+    if (!previous_outgoing_raw_command.has_value()) {
+        return true;
     }
 
-    RawCommand new_raw_command;
-    new_raw_command.buttonValue.resize(state_size);
-    new_raw_command.time = Time::now();
-    for (size_t i = 0; i < state_size; i++) {
-        new_raw_command.buttonValue.at(i) = gpio_state.states.at(i).data;
+    auto last_gpio_state_size = previous_outgoing_raw_command.value().buttonValue.size();
+    if (last_gpio_state_size != 0 && last_gpio_state_size != state_size) {
+        LOG_ERROR_S << "Expected a GPIOState with " << last_gpio_state_size
+                    << " elements, but got one with " << state_size << " elements";
+        return false;
+    }
+    return true;
+}
+
+bool GPIOStateWebsocketPublisherTask::isRefreshDue(Time const& now) const
+{
+    if (m_refresh_period.isNull() || m_debouncer.size() == 0) {
+        return false;
     }
+    return now - m_last_publication >= m_refresh_period;
+}
+
+void GPIOStateWebsocketPublisherTask::publish(Time const& time, Time const& now)
+{
+    updateOutgoingRawCommand(time);
+    m_last_publication = now;
+
+    if (state() != PUBLISHING) {
+        state(PUBLISHING);
+    }
+    publishBatchedRawCommand();
+}
+
+void GPIOStateWebsocketPublisherTask::updateOutgoingRawCommand(Time const& time)
+{
+    auto const& values = m_debouncer.values();
+    RawCommand new_raw_command;
+    new_raw_command.buttonValue.assign(values.begin(), values.end());
+    new_raw_command.time = time;
 
     lock_guard<mutex> lock(m_shared_data_lock);
-    m_outgoing_raw_command = new_raw_command;
+    setOutgoingRawCommand(new_raw_command, changesPriorityButtons(new_raw_command));
 }
@@ -3,6 +3,7 @@
 #ifndef GAMEPAD_WEBSOCKET_GPIOSTATEWEBSOCKETPUBLISHERTASK_TASK_HPP
 #define GAMEPAD_WEBSOCKET_GPIOSTATEWEBSOCKETPUBLISHERTASK_TASK_HPP
 
+#include "PinDebouncer.hpp"
 #include "base/Time.hpp"
 #include "controldev/RawCommand.hpp"
 #include "gamepad_websocket/GPIOStateWebsocketPublisherTaskBase.hpp"
@@ -106,12 +107,41 @@ namespace gamepad_websocket {
          */
         void cleanupHook();
 
+    protected:
+        void resetRunState() override;
+
     private:
+        PinDebouncer m_debouncer;
+        std::vector<base::Time> m_debounce_windows;
+        base::Time m_refresh_period;
+        /* Time at which the last outgoing raw command was set */
+        base::Time m_last_publication;
+
+        /**
+         * Checks that the given gpio state has as many pins as the ones published
+         * so far, and as debounce_window when it is given per pin
+         */
+        bool validateStateSize(linux_gpios::GPIOState const& gpio_state);
+
+        /**
+         * Whether the debounced state should be published again because nothing was
+         * published for the refresh period
+         */
+        bool isRefreshDue(base::Time const& now) const;
+
+        /**
+         * Makes the debounced gpio state the outgoing raw command and publishes it
+         *
+         * \param time the timestamp of the raw command
+         * \param now the current time
+         */
+        void publish(base::Time const& time, base::Time const& now);
+
         /**
-         * Transforms the given gpio state into a raw command and update the outgoing raw
-         * command.
+         * Transforms the debounced gpio state into a raw command with the given
+         * timestamp and update the outgoing raw command.
          */
-        void updateOutgoingRawCommand(linux_gpios::GPIOState const& gpio_state);
+        void updateOutgoingRawCommand(base::Time const& time);
     };
 }
 
@@ -0,0 +1,129 @@
+#include "PinDebouncer.hpp"
+
+using namespace base;
+using namespace gamepad_websocket;
+using namespace linux_gpios;
+using namespace std;
+
+PinDebouncer::PinDebouncer(vector<Time> const& windows,
+    vector<uint32_t> const& immediate_pins)
+    : m_windows(windows)
+    , m_immediate_pins(immediate_pins)
+{
+}
+
+bool PinDebouncer::isEnabled() const
+{
+    for (auto const& window : m_windows) {
+        if (!window.isNull()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PinDebouncer::update(GPIOState const& gpio_state, Time const& now)
+{
+    Time state_time = gpio_state.time.isNull() ? sampleTime(now) : gpio_state.time;
+    auto const& states = gpio_state.states;
+    if (m_values.empty() || m_values.size() != states.size()) {
+        m_values.resize(states.size());
+        m_pending.assign(states.size(), PendingChange());
+        for (size_t i = 0; i < states.size(); ++i) {
+            m_values[i] = states[i].data;
+        }
+        if (m_windows.size() == states.size()) {
+            m_pin_windows = m_windows;
+        }
+        else {
+            m_pin_windows.assign(states.size(),
+                m_windows.size() == 1 ? m_windows.front() : Time());
+        }
+        for (auto pin : m_immediate_pins) {
+            if (pin < m_pin_windows.size()) {
+                m_pin_windows[pin] = Time();
+            }
+        }
+        m_last_transition = state_time;
+        m_latest_sample = state_time;
+        m_latest_received = now;
+        return true;
+    }
+
+    Time latest = state_time;
+    for (size_t i = 0; i < states.size(); ++i) {
+        uint8_t value = states[i].data;
+        Time time = states[i].time.isNull() ? state_time : states[i].time;
+        latest = max(latest, time);
+
+        auto& pending = m_pending[i];
+        if (value == m_values[i]) {
+            pending.active = false;
+        }
+        else if (!pending.active || pending.value != value) {
+            pending = PendingChange{true, value, time};
+        }
+    }
+    if (m_latest_sample < latest) {
+        m_latest_sample = latest;
+    }
+    m_latest_received = now;
+    return confirm(m_latest_sample);
+}
+
+bool PinDebouncer::poll(Time const& now)
+{
+    return confirm(sampleTime(now));
+}
+
+Time PinDebouncer::sampleTime(Time const& now) const
+{
+    if (m_latest_received.isNull()) {
+        return now;
+    }
+    return m_latest_sample + (now - m_latest_received);
+}
+
+bool PinDebouncer::confirm(Time const& now)
+{
+    bool transition = false;
+    for (size_t i = 0; i < m_pending.size(); ++i) {
+        auto& pending = m_pending[i];
+        auto const& window = m_pin_windows[i];
+        if (!pending.active || (!window.isNull() && now - pending.since < window)) {
+            continue;
+        }
+        m_values[i] = pending.value;
+        pending.active = false;
+        if (!transition || m_last_transition < pending.since) {
+            m_last_transition = pending.since;
+        }
+        transition = true;
+    }
+    return transition;
+}
+
+size_t PinDebouncer::size() const
+{
+    return m_values.size();
+}
+
+vector<uint8_t> const& PinDebouncer::values() const
+{
+    return m_values;
+}
+
+Time const& PinDebouncer::lastTransition() const
+{
+    return m_last_transition;
+}
+
+void PinDebouncer::reset()
+{
+    m_values.clear();
+    m_pending.clear();
+    m_pin_windows.clear();
+    m_last_transition = Time();
+    m_latest_sample = Time();
+    m_latest_received = Time();
+}
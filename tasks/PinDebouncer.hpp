@@ -0,0 +1,114 @@
+#ifndef GAMEPAD_WEBSOCKET_PINDEBOUNCER_HPP
+#define GAMEPAD_WEBSOCKET_PINDEBOUNCER_HPP
+
+#include "base/Time.hpp"
+#include "linux_gpios/linux_gpiosTypes.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gamepad_websocket {
+    /*
+     * Debounces each pin of a GPIO state independently.
+     *
+     * A pin takes a new value only once it kept it for the debounce window. The
+     * window is measured with the timestamps of the GPIO samples, falling back to
+     * the timestamp of the whole state for the pins that have none, so that
+     * delayed or replayed samples are debounced the same way as live ones. The
+     * time of the transition is the time at which the pin first read the new
+     * value, not the time at which it was confirmed.
+     *
+     * The current time is only used to advance this sample clock by the time
+     * elapsed since the latest state was received, when polling without new
+     * states or when a state has no timestamp at all.
+     *
+     * Each pin has its own window. Some pins can also be exempted from debouncing,
+     * to get their changes without any delay.
+     */
+    class PinDebouncer {
+    public:
+        PinDebouncer() = default;
+        /*
+         * @param windows the time a pin must keep a new value for it to be taken,
+         *   indexed like the pins. A single window applies to all the pins, and
+         *   none disables debouncing.
+         * @param immediate_pins indexes of the pins whose changes are taken right
+         *   away
+         */
+        explicit PinDebouncer(std::vector<base::Time> const& windows,
+            std::vector<uint32_t> const& immediate_pins = {});
+
+        /*
+         * Whether any pin is debounced at all
+         */
+        bool isEnabled() const;
+
+        /*
+         * Feeds a new GPIO state. Returns whether any pin went through a debounced
+         * transition.
+         *
+         * The first state after construction or reset(), and any state whose number
+         * of pins changed, is taken as is and counts as a transition.
+         *
+         * @param now the time at which the state was received
+         */
+        bool update(linux_gpios::GPIOState const& gpio_state, base::Time const& now);
+
+        /*
+         * Confirms the pending changes that are older than the debounce window,
+         * for the pins that are not sampled again. Returns whether any pin went
+         * through a debounced transition.
+         *
+         * The pending changes are compared against the time of the latest state,
+         * advanced by the time elapsed since it was received.
+         *
+         * @param now the current time
+         */
+        bool poll(base::Time const& now);
+
+        /*
+         * The number of pins, zero until the first state is received
+         */
+        size_t size() const;
+
+        /*
+         * The debounced value of the pins
+         */
+        std::vector<uint8_t> const& values() const;
+
+        /*
+         * The time at which the pins first read the value of the latest debounced
+         * transition
+         */
+        base::Time const& lastTransition() const;
+
+        /*
+         * Forgets all the pins
+         */
+        void reset();
+
+    private:
+        struct PendingChange {
+            bool active = false;
+            uint8_t value = 0;
+            base::Time since;
+        };
+
+        bool confirm(base::Time const& now);
+        /* The sample clock at the given time, see poll() */
+        base::Time sampleTime(base::Time const& now) const;
+
+        std::vector<base::Time> m_windows;
+        std::vector<uint32_t> m_immediate_pins;
+        /* The window of each pin, which is zero for the immediate pins */
+        std::vector<base::Time> m_pin_windows;
+        std::vector<uint8_t> m_values;
+        std::vector<PendingChange> m_pending;
+        base::Time m_last_transition;
+        /* The time of the latest state, and the time at which it was received */
+        base::Time m_latest_sample;
+        base::Time m_latest_received;
+    };
+}
+
+#endif
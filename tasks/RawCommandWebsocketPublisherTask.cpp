@@ -7,6 +7,7 @@
 #include "rtt/FlowStatus.hpp"
 
 using namespace base;
+using namespace controldev;
 using namespace gamepad_websocket;
 using namespace std;
 
@@ -31,7 +32,38 @@ bool RawCommandWebsocketPublisherTask::configureHook()
     if (!validateDeviceIdTransform(device_id_transform_str)) {
         return false;
     }
-    m_device_id_transform = device_id_transform_str;
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        m_device_id_transform = device_id_transform_str;
+    }
+
+    AxisFilter::Configuration axis_filter_configuration;
+    axis_filter_configuration.deadband = _axis_deadband.get();
+    axis_filter_configuration.quantization = _axis_quantization.get();
+    axis_filter_configuration.min_change = _axis_min_change.get();
+    size_t axis_count = 0;
+    for (auto const* parameter : {&axis_filter_configuration.deadband,
+             &axis_filter_configuration.quantization,
+             &axis_filter_configuration.min_change}) {
+        for (auto value : *parameter) {
+            if (value < 0) {
+                LOG_ERROR_S << "axis_deadband, axis_quantization and axis_min_change "
+                               "must be positive or zero";
+                return false;
+            }
+        }
+        if (parameter->size() <= 1) {
+            continue;
+        }
+        if (axis_count != 0 && parameter->size() != axis_count) {
+            LOG_ERROR_S << "axis_deadband, axis_quantization and axis_min_change "
+                           "must have either a single element or one per axis, got "
+                        << axis_count << " and " << parameter->size() << " elements";
+            return false;
+        }
+        axis_count = parameter->size();
+    }
+    m_axis_filter = AxisFilter(axis_filter_configuration);
 
     return true;
 }
@@ -40,39 +72,92 @@ bool RawCommandWebsocketPublisherTask::startHook()
 {
     if (!RawCommandWebsocketPublisherTaskBase::startHook())
         return false;
-
-    m_device_identifier = {};
     return true;
 }
 
+void RawCommandWebsocketPublisherTask::resetRunState()
+{
+    RawCommandWebsocketPublisherTaskBase::resetRunState();
+    {
+        lock_guard<mutex> lock(m_shared_data_lock);
+        m_device_identifier = {};
+    }
+    m_axis_filter.reset();
+}
+
 void RawCommandWebsocketPublisherTask::updateHook()
 {
     RawCommandWebsocketPublisherTaskBase::updateHook();
 
     controldev::RawCommand raw_cmd;
-    if (_raw_command.read(raw_cmd) != RTT::NewData) {
-        return;
-    }
-
-    {
-        lock_guard<mutex> lock(m_shared_data_lock);
-        m_outgoing_raw_command = raw_cmd;
-        if (!m_device_identifier.has_value()) {
-            m_device_identifier = raw_cmd.deviceIdentifier;
+    for (uint32_t i = 0; i < m_input_batch_size; ++i) {
+        auto read_start = m_trace.now();
+        if (_raw_command.read(raw_cmd) != RTT::NewData) {
+            break;
         }
-        else if (m_device_identifier.value() != raw_cmd.deviceIdentifier) {
-            LOG_ERROR_S << "Detected that a different device was connected. That is not "
-                        << "supported. Got " << raw_cmd.deviceIdentifier << " but had "
-                        << m_device_identifier.value();
+        m_trace.record("raw_command read", read_start);
+
+        if (!validateDeviceIdentifier(raw_cmd)) {
+            publishDeferredRawCommand();
             exception(ID_MISMATCH);
             return;
         }
+        if (!validateAxisCount(raw_cmd)) {
+            publishDeferredRawCommand();
+            exception(AXIS_COUNT_MISMATCH);
+            return;
+        }
+        if (!updateOutgoingRawCommand(raw_cmd)) {
+            continue;
+        }
+        if (state() != PUBLISHING) {
+            state(PUBLISHING);
+        }
+        publishBatchedRawCommand();
     }
+    publishDeferredRawCommand();
+}
 
-    if (state() != PUBLISHING) {
-        state(PUBLISHING);
+bool RawCommandWebsocketPublisherTask::validateDeviceIdentifier(
+    RawCommand const& raw_cmd)
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    if (!m_device_identifier.has_value()) {
+        m_device_identifier = raw_cmd.deviceIdentifier;
+        return true;
+    }
+    if (m_device_identifier.value() != raw_cmd.deviceIdentifier) {
+        LOG_ERROR_S << "Detected that a different device was connected. That is not "
+                    << "supported. Got " << raw_cmd.deviceIdentifier << " but had "
+                    << m_device_identifier.value();
+        return false;
     }
-    publishRawCommand();
+    return true;
+}
+
+bool RawCommandWebsocketPublisherTask::validateAxisCount(RawCommand const& raw_cmd)
+{
+    size_t axis_count = m_axis_filter.axisCount();
+    if (axis_count == 0 || raw_cmd.axisValue.size() == axis_count) {
+        return true;
+    }
+    LOG_ERROR_S << "The axis_ properties are given for " << axis_count
+                << " axes, but got a raw command with " << raw_cmd.axisValue.size()
+                << " axes";
+    return false;
+}
+
+bool RawCommandWebsocketPublisherTask::updateOutgoingRawCommand(RawCommand& raw_cmd)
+{
+    lock_guard<mutex> lock(m_shared_data_lock);
+    // The filter accepts every button change, so priority samples always go
+    // through
+    if (m_axis_filter.isEnabled() && !m_axis_filter.update(raw_cmd)) {
+        m_filtered_samples++;
+        return false;
+    }
+    setOutgoingRawCommand(raw_cmd, changesPriorityButtons(raw_cmd));
+    return true;
 }
 
 void RawCommandWebsocketPublisherTask::errorHook()
@@ -4,6 +4,7 @@
 #define GAMEPAD_WEBSOCKET_RAWCOMMANDWEBSOCKETPUBLISHERTASK_TASK_HPP
 
 #include "gamepad_websocket/RawCommandWebsocketPublisherTaskBase.hpp"
+#include "AxisFilter.hpp"
 #include "base/Time.hpp"
 
 namespace gamepad_websocket {
@@ -30,7 +31,7 @@ namespace gamepad_websocket {
         friend class RawCommandWebsocketPublisherTaskBase;
 
     protected:
-        
+        AxisFilter m_axis_filter;
 
     public:
         /** TaskContext constructor for RawCommandWebsocketPublisherTask
@@ -104,6 +105,28 @@ namespace gamepad_websocket {
          * before calling start() again.
          */
         void cleanupHook();
+
+    protected:
+        void resetRunState() override;
+
+    private:
+        /**
+         * Records the device identifier of the first raw command, and checks that
+         * the next ones have the same
+         */
+        bool validateDeviceIdentifier(controldev::RawCommand const& raw_cmd);
+
+        /**
+         * Checks that the given raw command has as many axes as the axis_
+         * properties, when they are given per axis
+         */
+        bool validateAxisCount(controldev::RawCommand const& raw_cmd);
+
+        /**
+         * Filters the given raw command and makes it the outgoing raw command.
+         * Returns false if the filter rejected it.
+         */
+        bool updateOutgoingRawCommand(controldev::RawCommand& raw_cmd);
     };
 }
 
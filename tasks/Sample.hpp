@@ -0,0 +1,28 @@
+#ifndef GAMEPAD_WEBSOCKET_SAMPLE_HPP
+#define GAMEPAD_WEBSOCKET_SAMPLE_HPP
+
+#include "controldev/RawCommand.hpp"
+
+#include <cstdint>
+
+namespace gamepad_websocket {
+    /*
+     * A raw command waiting to be published, alongside the sequence number it got
+     * when it was received by the task.
+     *
+     * Sequence numbers start at 1 and are incremented for every input sample, so
+     * a gap seen by a client means samples were lost before reaching it.
+     */
+    struct Sample {
+        uint64_t sequence = 0;
+        controldev::RawCommand raw_command;
+        /* Whether the sample changed a priority button. Priority samples are
+         * published right away and are never skipped nor dropped. */
+        bool priority = false;
+        /* Time at which the task received a priority sample, to measure its
+         * publishing latency */
+        base::Time received_at;
+    };
+}
+
+#endif
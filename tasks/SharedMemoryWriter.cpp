@@ -0,0 +1,118 @@
+#include "SharedMemoryWriter.hpp"
+
+#include "base-logging/Logging.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace gamepad_websocket;
+using namespace std;
+
+SharedMemoryWriter::~SharedMemoryWriter()
+{
+    close();
+}
+
+bool SharedMemoryWriter::open(string const& name, uint32_t capacity)
+{
+    close();
+
+    // Readers that still map a previous segment of the same name keep it, while
+    // new readers get this one
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        LOG_ERROR_S << "Failed to create the shared memory segment " << name << ": "
+                    << strerror(errno);
+        return false;
+    }
+    size_t size = shm::segmentSize(capacity);
+    if (ftruncate(fd, size) < 0) {
+        LOG_ERROR_S << "Failed to resize the shared memory segment " << name << ": "
+                    << strerror(errno);
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        LOG_ERROR_S << "Failed to map the shared memory segment " << name << ": "
+                    << strerror(errno);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // The segment is zero-filled by ftruncate, which is a valid initial state for
+    // all the fields but the ones below
+    auto header = new (memory) shm::Header();
+    header->version = shm::VERSION;
+    header->capacity = capacity;
+    header->slot_size = sizeof(shm::Slot);
+    header->write_index.store(0, memory_order_relaxed);
+    auto slots = shm::slots(header);
+    for (uint32_t i = 0; i < capacity; ++i) {
+        new (&slots[i]) shm::Slot();
+    }
+    header->magic.store(shm::MAGIC, memory_order_release);
+
+    m_name = name;
+    m_header = header;
+    m_size = size;
+    return true;
+}
+
+void SharedMemoryWriter::close()
+{
+    if (!m_header) {
+        return;
+    }
+    munmap(m_header, m_size);
+    shm_unlink(m_name.c_str());
+    m_header = nullptr;
+    m_size = 0;
+    m_name.clear();
+}
+
+bool SharedMemoryWriter::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+string const& SharedMemoryWriter::name() const
+{
+    return m_name;
+}
+
+uint32_t SharedMemoryWriter::capacity() const
+{
+    return m_header ? m_header->capacity : 0;
+}
+
+void SharedMemoryWriter::write(Sample const& sample)
+{
+    uint64_t index = m_header->write_index.load(memory_order_relaxed);
+    auto& slot = shm::slots(m_header)[index % m_header->capacity];
+
+    uint64_t lock = slot.lock.load(memory_order_relaxed);
+    slot.lock.store(lock + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    auto const& raw_command = sample.raw_command;
+    auto& data = slot.data;
+    slot.index = index;
+    data.sequence = sample.sequence;
+    data.time = raw_command.time.toMicroseconds();
+    data.axis_count = min(raw_command.axisValue.size(), shm::MAX_AXES);
+    data.button_count = min(raw_command.buttonValue.size(), shm::MAX_BUTTONS);
+    copy_n(raw_command.axisValue.begin(), data.axis_count, data.axes);
+    copy_n(raw_command.buttonValue.begin(), data.button_count, data.buttons);
+
+    slot.lock.store(lock + 2, memory_order_release);
+    m_header->write_index.store(index + 1, memory_order_release);
+}
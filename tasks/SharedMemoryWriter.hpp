@@ -0,0 +1,56 @@
+#ifndef GAMEPAD_WEBSOCKET_SHAREDMEMORYWRITER_HPP
+#define GAMEPAD_WEBSOCKET_SHAREDMEMORYWRITER_HPP
+
+#include "Sample.hpp"
+
+#include <gamepad_websocket/shm/Layout.hpp>
+#include <string>
+
+namespace gamepad_websocket {
+    /*
+     * Writes the outgoing samples in a POSIX shared memory segment, for the
+     * consumers running on the same host. See shm/Layout.hpp for the layout of
+     * the segment and shm/Reader.hpp for the reading side.
+     *
+     * There must be a single writer per segment. Writing does not block, does not
+     * allocate and does not make any system call.
+     */
+    class SharedMemoryWriter {
+    public:
+        SharedMemoryWriter() = default;
+
+        /*
+         * Unmaps and removes the segment
+         */
+        ~SharedMemoryWriter();
+
+        SharedMemoryWriter(SharedMemoryWriter const&) = delete;
+        SharedMemoryWriter& operator=(SharedMemoryWriter const&) = delete;
+
+        /*
+         * Creates the segment of the given name, holding the given number of
+         * samples. An existing segment of the same name is replaced.
+         */
+        bool open(std::string const& name, uint32_t capacity);
+
+        void close();
+
+        bool isOpen() const;
+
+        std::string const& name() const;
+        uint32_t capacity() const;
+
+        /*
+         * Writes the sample in the next slot of the ring. Axes and buttons beyond
+         * the maximum counts of the layout are left out.
+         */
+        void write(Sample const& sample);
+
+    private:
+        std::string m_name;
+        shm::Header* m_header = nullptr;
+        size_t m_size = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,130 @@
+#include "Trace.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <jsoncpp/json/value.h>
+#include <jsoncpp/json/writer.h>
+
+using namespace gamepad_websocket;
+using namespace std;
+
+static uint32_t currentThreadTraceId()
+{
+    static atomic<uint32_t> next_id{1};
+    thread_local uint32_t id = next_id++;
+    return id;
+}
+
+Trace::Trace(size_t capacity)
+{
+    reset(capacity);
+}
+
+void Trace::reset(size_t capacity)
+{
+    m_events.reset(capacity ? new Event[capacity] : nullptr);
+    m_capacity = capacity;
+    m_next = 0;
+}
+
+bool Trace::isEnabled() const
+{
+    return m_capacity != 0;
+}
+
+uint64_t Trace::now() const
+{
+    if (!isEnabled()) {
+        return 0;
+    }
+    auto since_epoch = chrono::steady_clock::now().time_since_epoch();
+    return chrono::duration_cast<chrono::microseconds>(since_epoch).count();
+}
+
+void Trace::record(char const* name, uint64_t start, uint64_t sequence)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    uint64_t end = now();
+    uint64_t index = m_next.fetch_add(1, memory_order_relaxed);
+    auto& event = m_events[index % m_capacity];
+
+    // Take the slot, unless another writer holds it or already wrote a newer
+    // event in it
+    uint64_t lock = event.lock.load(memory_order_relaxed);
+    if ((lock & 1) || lock > 2 * index ||
+        !event.lock.compare_exchange_strong(lock,
+            2 * index + 1,
+            memory_order_relaxed)) {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+    event.name.store(name, memory_order_relaxed);
+    event.start.store(start, memory_order_relaxed);
+    event.duration.store(end - start, memory_order_relaxed);
+    event.sequence.store(sequence, memory_order_relaxed);
+    event.thread.store(currentThreadTraceId(), memory_order_relaxed);
+    event.lock.store(2 * index + 2, memory_order_release);
+}
+
+bool Trace::dump(string const& path) const
+{
+    Json::Value events = Json::arrayValue;
+    for (size_t i = 0; i < m_capacity; ++i) {
+        auto const& event = m_events[i];
+        uint64_t lock = event.lock.load(memory_order_acquire);
+        if (lock == 0 || (lock & 1)) {
+            continue;
+        }
+
+        Json::Value json;
+        json["name"] = event.name.load(memory_order_relaxed);
+        json["ph"] = "X";
+        json["pid"] = 1;
+        json["tid"] = event.thread.load(memory_order_relaxed);
+        json["ts"] = static_cast<Json::UInt64>(event.start.load(memory_order_relaxed));
+        json["dur"] =
+            static_cast<Json::UInt64>(event.duration.load(memory_order_relaxed));
+        json["args"]["seq"] =
+            static_cast<Json::UInt64>(event.sequence.load(memory_order_relaxed));
+
+        // Skip the event if it got overwritten while we were reading it
+        atomic_thread_fence(memory_order_acquire);
+        if (event.lock.load(memory_order_relaxed) != lock) {
+            continue;
+        }
+        events.append(json);
+    }
+
+    Json::Value trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+
+    ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    Json::FastWriter writer;
+    file << writer.write(trace);
+    return static_cast<bool>(file);
+}
+
+TraceScope::TraceScope(Trace& trace, char const* name, uint64_t sequence)
+    : m_trace(trace)
+    , m_name(name)
+    , m_start(trace.now())
+    , m_sequence(sequence)
+{
+}
+
+TraceScope::~TraceScope()
+{
+    m_trace.record(m_name, m_start, m_sequence);
+}
+
+void TraceScope::setSequence(uint64_t sequence)
+{
+    m_sequence = sequence;
+}
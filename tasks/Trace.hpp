@@ -0,0 +1,93 @@
+#ifndef GAMEPAD_WEBSOCKET_TRACE_HPP
+#define GAMEPAD_WEBSOCKET_TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace gamepad_websocket {
+    /*
+     * In-memory recorder of timed events along the publishing pipeline, which can
+     * be written in the Chrome trace event format to be inspected with a trace
+     * viewer (e.g. chrome://tracing or Perfetto).
+     *
+     * Events are stored in a fixed-size ring buffer, overwriting the oldest ones.
+     * Recording is lock-free and does not allocate, so that it can be called from
+     * any thread in the publishing path. A disabled trace (zero capacity) only costs
+     * a branch per event. An event is dropped if its slot is being written by
+     * another thread, which only happens when the ring wraps around during a
+     * single record.
+     */
+    class Trace {
+    public:
+        explicit Trace(size_t capacity = 0);
+
+        /*
+         * Discards all events and reallocates the buffer for the given capacity.
+         * Must not be called while other threads may record events.
+         */
+        void reset(size_t capacity);
+
+        bool isEnabled() const;
+
+        /*
+         * Current time in microseconds on the trace clock, or zero if the trace is
+         * disabled
+         */
+        uint64_t now() const;
+
+        /*
+         * Records an event that started at the given time (from #now) and ends now
+         *
+         * @param name a string with static lifetime naming the event
+         * @param sequence the sequence number of the sample the event is about,
+         *   or zero if there is none
+         */
+        void record(char const* name, uint64_t start, uint64_t sequence = 0);
+
+        /*
+         * Writes the events currently in the buffer to the given file in the Chrome
+         * trace event JSON format. Returns false if the file could not be written.
+         *
+         * Can be called while events are being recorded. Events overwritten while
+         * dumping are skipped.
+         */
+        bool dump(std::string const& path) const;
+
+    private:
+        struct Event {
+            /* Sequence lock of the slot. Zero while it is empty, odd while the
+             * event of index i is being written (2i + 1), and 2i + 2 once it is
+             * complete */
+            std::atomic<uint64_t> lock{0};
+            std::atomic<char const*> name{nullptr};
+            std::atomic<uint64_t> start{0};
+            std::atomic<uint64_t> duration{0};
+            std::atomic<uint64_t> sequence{0};
+            std::atomic<uint32_t> thread{0};
+        };
+
+        std::unique_ptr<Event[]> m_events;
+        size_t m_capacity = 0;
+        std::atomic<uint64_t> m_next{0};
+    };
+
+    /*
+     * Records an event covering the lifetime of this object
+     */
+    class TraceScope {
+        Trace& m_trace;
+        char const* m_name;
+        uint64_t m_start;
+        uint64_t m_sequence;
+
+    public:
+        TraceScope(Trace& trace, char const* name, uint64_t sequence = 0);
+        ~TraceScope();
+
+        void setSequence(uint64_t sequence);
+    };
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include "UdpPublisher.hpp"
+
+#include "base-logging/Logging.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace gamepad_websocket;
+using namespace std;
+
+UdpPublisher::~UdpPublisher()
+{
+    close();
+}
+
+bool UdpPublisher::open(string const& address, uint16_t port, uint8_t multicast_ttl)
+{
+    close();
+
+    sockaddr_in destination{};
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &destination.sin_addr) != 1) {
+        LOG_ERROR_S << "udp_address " << address << " is not a valid IPv4 address";
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR_S << "Failed to create the UDP socket: " << strerror(errno);
+        return false;
+    }
+
+    if (IN_MULTICAST(ntohl(destination.sin_addr.s_addr))) {
+        unsigned char ttl = multicast_ttl;
+        unsigned char loop = 1;
+        if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+            setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+            LOG_ERROR_S << "Failed to configure multicast on the UDP socket: "
+                        << strerror(errno);
+            ::close(fd);
+            return false;
+        }
+    }
+
+    m_socket = fd;
+    m_destination = destination;
+    return true;
+}
+
+void UdpPublisher::close()
+{
+    if (m_socket >= 0) {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+}
+
+bool UdpPublisher::isOpen() const
+{
+    return m_socket >= 0;
+}
+
+bool UdpPublisher::send(string const& payload) const
+{
+    auto sent = sendto(m_socket,
+        payload.data(),
+        payload.size(),
+        MSG_DONTWAIT | MSG_NOSIGNAL,
+        reinterpret_cast<sockaddr const*>(&m_destination),
+        sizeof(m_destination));
+    return sent == static_cast<ssize_t>(payload.size());
+}
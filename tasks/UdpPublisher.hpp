@@ -0,0 +1,50 @@
+#ifndef GAMEPAD_WEBSOCKET_UDPPUBLISHER_HPP
+#define GAMEPAD_WEBSOCKET_UDPPUBLISHER_HPP
+
+#include <cstdint>
+#include <netinet/in.h>
+#include <string>
+
+namespace gamepad_websocket {
+    /*
+     * Sends datagrams to a single IPv4 destination, unicast or multicast, through
+     * a non-blocking socket.
+     *
+     * Sending never waits: a datagram that cannot be sent right away is lost. This
+     * suits control streams, in which a newer sample is worth more than an older
+     * one delivered late.
+     */
+    class UdpPublisher {
+    public:
+        UdpPublisher() = default;
+        ~UdpPublisher();
+
+        UdpPublisher(UdpPublisher const&) = delete;
+        UdpPublisher& operator=(UdpPublisher const&) = delete;
+
+        /*
+         * Opens the socket towards the given address and port
+         *
+         * Multicast datagrams are sent with the given time-to-live and are looped
+         * back to the receivers of the local host.
+         */
+        bool open(std::string const& address, uint16_t port, uint8_t multicast_ttl);
+
+        void close();
+
+        bool isOpen() const;
+
+        /*
+         * Sends the payload as a single datagram. Returns false if it could not be
+         * sent right away, or is too large for a datagram. Can be called from
+         * several threads.
+         */
+        bool send(std::string const& payload) const;
+
+    private:
+        int m_socket = -1;
+        sockaddr_in m_destination{};
+    };
+}
+
+#endif
@@ -1,8 +1,9 @@
 #include "WebsocketHandler.hpp"
+#include "AsyncLogger.hpp"
 #include "BaseWebsocketPublisherTask.hpp"
 #include "Client.hpp"
+#include "ClientPool.hpp"
 
-#include "base-logging/Logging.hpp"
 #include "controldev/RawCommand.hpp"
 
 #include <algorithm>
@@ -35,82 +36,135 @@ static Json::Value buttonsToJson(vector<uint8_t> const& button_cmds)
     return buttons;
 }
 
-static Json::Value rawCommandToJson(controldev::RawCommand const& raw_cmd)
+static Json::Value sampleToJson(Sample const& sample)
 {
+    auto const& raw_cmd = sample.raw_command;
     Json::Value out_msg;
+    out_msg["seq"] = static_cast<Json::UInt64>(sample.sequence);
     out_msg["timestamp"] = static_cast<Json::UInt64>(raw_cmd.time.toMilliseconds());
     out_msg["axes"] = axesToJson(raw_cmd.axisValue);
     out_msg["buttons"] = buttonsToJson(raw_cmd.buttonValue);
     return out_msg;
 }
 
+static bool isStale(Time const& sample_time, Time const& now, Time const& max_age)
+{
+    if (max_age.isNull() || sample_time.isNull()) {
+        return false;
+    }
+    return now - sample_time > max_age;
+}
+
+static void tagSampleAge(Json::Value& sample_json, Sample const& sample, Time const& now)
+{
+    auto age = now - sample.raw_command.time;
+    sample_json["age"] = static_cast<Json::Int64>(age.toMilliseconds());
+}
+
 WebsocketHandler::WebsocketHandler(BaseWebsocketPublisherTask* task,
-    string const& device_id_transform)
-    : m_task(task)
-    , m_device_id_transform(device_id_transform)
+    size_t max_clients,
+    ClientAdmissionPolicy admission_policy,
+    size_t shard)
+    : m_clients(max_clients)
+    , m_admission_policy(admission_policy)
+    , m_shard(shard)
+    , m_task(task)
 {
     if (task == nullptr) {
         throw invalid_argument("WebsocketHandler task cannot be a nullptr");
     }
+    m_closing_sockets.reserve(max_clients);
 }
 
 void WebsocketHandler::onConnect(WebSocket* socket)
 {
+    auto admission = m_clients.admit(socket, m_admission_policy);
+    if (admission.evicted) {
+        m_task->logger().logf(Logger::Level::Warning,
+            "Reached the maximum of %zu clients, closing the oldest connection",
+            m_clients.capacity());
+        closeSocket(admission.evicted);
+    }
+    if (!admission.client) {
+        m_task->logger().logf(Logger::Level::Warning,
+            "Reached the maximum of %zu clients, rejecting the new connection",
+            m_clients.capacity());
+        closeSocket(socket);
+        reportStatistics();
+        return;
+    }
+
     auto device_identifier = m_task->deviceIdentifier();
     if (!device_identifier.has_value()) {
-        Client client;
-        client.connection = socket;
-        m_pending_sockets.push_back(client);
         return;
     }
-    device_identifier = transformDeviceId(device_identifier.value());
-
-    Json::FastWriter writer;
-    Json::Value response;
-    response["id"] = device_identifier.value();
-    socket->send(writer.write(response));
-
-    Client new_socket;
-    new_socket.connection = socket;
-
-    m_active_sockets.push_back(new_socket);
-    m_task->outputStatistics(m_active_sockets);
+    socket->send(handshake(device_identifier.value()));
+    admission.client->active = true;
+    reportStatistics();
 }
 
 void WebsocketHandler::onData(WebSocket* socket, const char* data)
 {
-    auto active_client = clientFromListBySocket(m_active_sockets, socket);
-    if (!active_client.has_value()) {
-        LOG_ERROR_S << "Got data from a connection that is not active!";
+    auto client = m_clients.find(socket);
+    if (!client || !client->active) {
+        m_task->logger().log(Logger::Level::Error,
+            "Got data from a connection that is not active!");
         return;
     }
 
-    (*active_client)->statistics.received++;
-    (*active_client)->statistics.last_received_message = Time::now();
-    m_task->outputStatistics(m_active_sockets);
+    client->statistics.received++;
+    client->statistics.last_received_message = Time::now();
+    reportStatistics();
 }
 
 void WebsocketHandler::onDisconnect(WebSocket* socket)
 {
-    auto client = clientFromListBySocket(m_active_sockets, socket);
-    if (client.has_value()) {
-        m_active_sockets.erase(client.value());
-        m_task->outputStatistics(m_active_sockets);
+    if (m_clients.remove(socket)) {
+        reportStatistics();
         return;
     }
-    client = clientFromListBySocket(m_pending_sockets, socket);
-    if (client.has_value()) {
-        m_pending_sockets.erase(client.value());
-        m_task->outputStatistics(m_active_sockets);
+
+    auto closing_it = find_if(m_closing_sockets.begin(),
+        m_closing_sockets.end(),
+        [socket](ClosingSocket const& closing) { return closing.socket == socket; });
+    if (closing_it != m_closing_sockets.end()) {
+        *closing_it = m_closing_sockets.back();
+        m_closing_sockets.pop_back();
+        return;
+    }
+    if (m_forgotten_closing_sockets != 0) {
+        m_forgotten_closing_sockets--;
         return;
     }
 
-    LOG_ERROR_S << "Trying to disconnect a socket that is not active or pending!";
+    m_task->logger().log(Logger::Level::Error,
+        "Trying to disconnect a socket that is not active or pending!");
+}
+
+void WebsocketHandler::closeSocket(WebSocket* socket)
+{
+    ClosingSocket closing{socket, m_closing_serial++};
+    if (m_closing_sockets.size() < m_closing_sockets.capacity()) {
+        m_closing_sockets.push_back(closing);
+    }
+    else {
+        auto oldest = min_element(m_closing_sockets.begin(),
+            m_closing_sockets.end(),
+            [](ClosingSocket const& a, ClosingSocket const& b) {
+                return a.serial < b.serial;
+            });
+        *oldest = closing;
+        m_forgotten_closing_sockets++;
+    }
+    socket->close();
 }
 
 void WebsocketHandler::processPendingPeers()
 {
-    if (m_pending_sockets.empty()) {
+    bool has_pending = any_of(m_clients.begin(),
+        m_clients.end(),
+        [](Client const& client) { return !client.active; });
+    if (!has_pending) {
         return;
     }
 
@@ -118,65 +172,201 @@ void WebsocketHandler::processPendingPeers()
     if (!device_identifier.has_value()) {
         return;
     }
-    device_identifier = transformDeviceId(device_identifier.value());
+    auto const& json_pkt = handshake(device_identifier.value());
+    for (auto& client : m_clients) {
+        if (!client.active) {
+            client.connection->send(json_pkt);
+            client.active = true;
+        }
+    }
+    reportStatistics();
+}
 
-    Json::FastWriter writer;
-    Json::Value response;
-    response["id"] = device_identifier.value();
-    auto json_pkt = writer.write(response);
+void WebsocketHandler::reportStatistics()
+{
+    m_task->outputStatistics(m_shard, m_clients, m_skipped_frames);
+}
+
+void WebsocketHandler::publishFrame(shared_ptr<Frame> const& frame)
+{
+    processPendingPeers();
 
-    while (!m_pending_sockets.empty()) {
-        auto& client = m_pending_sockets.back();
-        client.connection->send(json_pkt);
+    // Frames holding a single sample are replaced by the newer ones, which are
+    // already queued. This lets the shards catch up quickly on a backlog, and
+    // publish a priority frame queued behind it sooner
+    if (!frame->bundle && !frame->priority && m_task->isSuperseded(*frame)) {
+        m_skipped_frames++;
+        return;
+    }
 
-        m_active_sockets.push_back(client);
-        m_pending_sockets.pop_back();
+    {
+        lock_guard<mutex> lock(frame->encoding);
+        if (!frame->encoded) {
+            encodeFrame(*frame);
+            frame->encoded = true;
+        }
     }
-    m_task->outputStatistics(m_active_sockets);
+    if (frame->payload.empty()) {
+        reportStatistics();
+        return;
+    }
+    sendToActiveSockets(*frame);
 }
 
-void WebsocketHandler::publishData()
+void WebsocketHandler::encodeFrame(Frame& frame)
 {
-    processPendingPeers();
-    auto outgoing_raw_command = m_task->outgoingRawCommand();
-    if (m_task && !outgoing_raw_command.has_value()) {
-        LOG_WARN_S << "Task has no raw command to publish";
+    TraceScope trace(m_task->trace(), "encode", frame.sequence);
+    if (!m_task->claimFrame(frame)) {
+        return;
+    }
+
+    auto now = Time::now();
+    auto max_age = m_task->maxSampleAge();
+    auto stale_policy = m_task->staleSamplePolicy();
+    uint64_t stale = 0;
+    Json::Value samples = Json::arrayValue;
+    for (auto const& sample : frame.samples) {
+        auto sample_json = sampleToJson(sample);
+        if (isStale(sample.raw_command.time, now, max_age)) {
+            stale++;
+            // Priority samples are always published, tagged if need be
+            if (stale_policy == DROP_STALE_SAMPLES && !sample.priority) {
+                continue;
+            }
+            tagSampleAge(sample_json, sample, now);
+        }
+        samples.append(sample_json);
+    }
+    if (stale != 0) {
+        m_task->countStaleSamples(stale);
+    }
+    if (samples.empty()) {
         return;
     }
 
     Json::FastWriter fast;
-    auto raw_cmd = outgoing_raw_command.value();
-    auto msg = rawCommandToJson(raw_cmd);
-    for (auto& socket : m_active_sockets) {
-        socket.connection->send(fast.write(msg));
-        socket.statistics.sent++;
-        socket.statistics.last_sent_message = Time::now();
+    if (frame.bundle) {
+        Json::Value msg;
+        msg["samples"] = samples;
+        frame.payload = fast.write(msg);
+    }
+    else {
+        frame.payload = fast.write(samples[0]);
     }
-    m_task->outputStatistics(m_active_sockets);
+    {
+        TraceScope trace(m_task->trace(), "udp send", frame.sequence);
+        m_task->sendDatagram(frame.payload);
+    }
+    m_task->samplePublished(frame.sequence);
 }
 
-optional<vector<Client>::iterator> WebsocketHandler::clientFromListBySocket(
-    vector<Client>& clients_list,
-    seasocks::WebSocket* const socket)
+void WebsocketHandler::sendToActiveSockets(Frame const& frame)
 {
-    auto client_itt = find_if(clients_list.begin(),
-        clients_list.end(),
-        [socket](Client const& client) { return client.connection == socket; });
-    if (client_itt == clients_list.end()) {
-        return {};
+    auto const& payload = frame.payload;
+    auto sequence = frame.sequence;
+    for (auto& client : m_clients) {
+        if (!client.active) {
+            continue;
+        }
+        {
+            TraceScope trace(m_task->trace(), "send", sequence);
+            client.connection->send(payload);
+        }
+        client.statistics.sent++;
+        client.statistics.last_sent_message = Time::now();
+        client.statistics.last_sent_sequence = sequence;
+    }
+    if (frame.priority) {
+        m_task->priorityPublished(frame.samples.back().received_at);
     }
-    return client_itt;
+    reportStatistics();
+}
+
+string const& WebsocketHandler::handshake(string const& device_identifier)
+{
+    auto snapshot = m_task->outgoingSample();
+    uint64_t snapshot_sequence = snapshot.has_value() ? snapshot->sequence : 0;
+    auto transformed_identifier = transformDeviceId(device_identifier);
+    // The state is subject to max_sample_age like the published samples. A stale
+    // handshake is not cached, as its age tag changes over time
+    auto now = Time::now();
+    bool stale = snapshot.has_value() &&
+                 isStale(snapshot->raw_command.time, now, m_task->maxSampleAge());
+    if (!stale && m_handshake_device_identifier == transformed_identifier &&
+        m_handshake_sequence == snapshot_sequence && m_handshake_paused == m_paused) {
+        return m_handshake;
+    }
+
+    Json::FastWriter writer;
+    Json::Value response;
+    response["id"] = transformed_identifier;
+    response["status"] = m_paused ? "paused" : "running";
+    if (!stale) {
+        if (snapshot.has_value()) {
+            response["state"] = sampleToJson(snapshot.value());
+        }
+    }
+    else {
+        m_task->countStaleSamples(1);
+        if (m_task->staleSamplePolicy() != DROP_STALE_SAMPLES ||
+            snapshot->priority) {
+            auto state = sampleToJson(snapshot.value());
+            tagSampleAge(state, snapshot.value(), now);
+            response["state"] = state;
+        }
+    }
+    m_handshake = writer.write(response);
+    if (stale) {
+        m_handshake_device_identifier.reset();
+    }
+    else {
+        m_handshake_device_identifier = transformed_identifier;
+        m_handshake_sequence = snapshot_sequence;
+        m_handshake_paused = m_paused;
+    }
+    return m_handshake;
+}
+
+void WebsocketHandler::setPaused(bool paused)
+{
+    if (m_paused == paused) {
+        return;
+    }
+    m_paused = paused;
+
+    Json::FastWriter writer;
+    Json::Value notification;
+    notification["status"] = paused ? "paused" : "resumed";
+    auto payload = writer.write(notification);
+    for (auto& client : m_clients) {
+        if (client.active) {
+            client.connection->send(payload);
+        }
+    }
+    if (paused) {
+        return;
+    }
+
+    // The task starts over, with sequence numbers restarting at 1 and possibly
+    // another device. Make the clients pending again so that they get a new
+    // handshake, and drop the cached one, which may match the new sequence numbers
+    m_handshake_device_identifier.reset();
+    for (auto& client : m_clients) {
+        client.active = false;
+    }
+    processPendingPeers();
 }
 
 string WebsocketHandler::transformDeviceId(string const& device_identifier) const
 {
-    if (m_device_id_transform.empty()) {
+    auto device_id_transform = m_task->deviceIdTransform();
+    if (device_id_transform.empty()) {
         return device_identifier;
     }
 
     size_t pos = 0;
-    string result = m_device_id_transform;
-    if ((pos = m_device_id_transform.find("%1", pos)) != string::npos) {
+    string result = device_id_transform;
+    if ((pos = device_id_transform.find("%1", pos)) != string::npos) {
         result.replace(pos, 2, device_identifier);
     }
     return result;
@@ -3,6 +3,7 @@
 
 #include "BaseWebsocketPublisherTask.hpp"
 #include "Client.hpp"
+#include "ClientPool.hpp"
 
 #include <optional>
 #include <seasocks/WebSocket.h>
@@ -13,37 +14,102 @@ namespace gamepad_websocket {
      * define the callbacks the server calls for each interaction from a client.
      */
     class WebsocketHandler : public seasocks::WebSocket::Handler {
-        std::vector<Client> m_active_sockets;
-        std::vector<Client> m_pending_sockets;
+        ClientPool m_clients;
+        ClientAdmissionPolicy m_admission_policy = REJECT_NEW_CLIENTS;
+        /* A connection closed by the handler, waiting for its disconnection */
+        struct ClosingSocket {
+            seasocks::WebSocket* socket = nullptr;
+            /* Order in which the sockets were closed */
+            uint64_t serial = 0;
+        };
+        /* Holds at most max_clients sockets. Once full, the oldest one is
+         * forgotten to make room for a new one, so that closing connections never
+         * allocates */
+        std::vector<ClosingSocket> m_closing_sockets;
+        uint64_t m_closing_serial = 0;
+        /* Count of closed sockets forgotten before their disconnection */
+        uint64_t m_forgotten_closing_sockets = 0;
+        /* Index of the shard this handler serves, used to report statistics */
+        size_t m_shard = 0;
+        /* Count of frames not sent because a newer one was already queued */
+        uint64_t m_skipped_frames = 0;
+
+        /* Whether the task is stopped. The server outlives the task's runs, and
+         * clients are notified when it stops and starts again */
+        bool m_paused = true;
+
+        /* Serialized message sent to the clients when they become active */
+        std::string m_handshake;
+        /* Device identifier, snapshot sequence and pause state m_handshake was built
+         * from */
+        std::optional<std::string> m_handshake_device_identifier;
+        uint64_t m_handshake_sequence = 0;
+        bool m_handshake_paused = false;
 
         void onConnect(seasocks::WebSocket* socket) override;
         void onData(seasocks::WebSocket* socket, const char* data) override;
         void onDisconnect(seasocks::WebSocket* socket) override;
 
         void processPendingPeers();
+        void reportStatistics();
+        void encodeFrame(Frame& frame);
+        void sendToActiveSockets(Frame const& frame);
         std::string transformDeviceId(std::string const& device_identifier) const;
 
-        std::optional<std::vector<Client>::iterator> clientFromListBySocket(
-            std::vector<Client>& clients_list,
-            seasocks::WebSocket* const socket);
+        /*
+         * Returns the message sent to a client when it becomes active, that is the
+         * transformed device identifier, the task status and the latest outgoing
+         * sample, if any.
+         *
+         * The message is serialized only when any of them changed since the last
+         * call.
+         */
+        std::string const& handshake(std::string const& device_identifier);
+
+        void closeSocket(seasocks::WebSocket* socket);
 
     public:
+        /**
+         * @param max_clients the maximum number of connections, pending or active.
+         *   Storage for them is allocated at construction
+         * @param admission_policy what to do with new connections once max_clients
+         *   is reached
+         * @param shard the index of the shard served by this handler
+         */
         WebsocketHandler(BaseWebsocketPublisherTask* task = nullptr,
-            std::string const& device_id_transform = "");
+            size_t max_clients = 32,
+            ClientAdmissionPolicy admission_policy = REJECT_NEW_CLIENTS,
+            size_t shard = 0);
 
         /**
-         * @brief Publishes the outgoing RawCommand stored in the task to all
-         * the active clients. Does nothing when no RawCommand is available yet.
+         * @brief Publishes the given frame to all the active clients of this
+         * handler.
          *
-         * The underlying task is responsible for filling the outgoing raw command
-         * according to its own interface.
+         * The underlying task is responsible for making frames out of its
+         * outgoing raw commands according to its own interface. The frame is
+         * encoded by the first handler that publishes it, and the other shards reuse
+         * the encoded message. A frame holding a single sample is skipped if a
+         * newer one was queued in the meantime.
+         *
+         * Each published sample carries its sequence number in the "seq" field, so
+         * that clients can detect lost samples. Samples older than the task's
+         * maximum sample age are either dropped or tagged with their age.
+         */
+        void publishFrame(std::shared_ptr<Frame> const& frame);
+
+        /**
+         * @brief Tells the active clients that the task stopped or started, by
+         * sending {"status": "paused"} or {"status": "resumed"}
+         *
+         * The status is also part of the handshake of new clients, as "paused" or
+         * "running". On resume, the connected clients are handed a new handshake
+         * once the device identifier is known, as for new clients. Sequence
+         * numbers restart at 1 after it.
          */
-        void publishData();
+        void setPaused(bool paused);
 
         /* Pointer to the base task for information shared with *this. */
         BaseWebsocketPublisherTask* m_task = nullptr;
-
-        std::string m_device_id_transform = "";
     };
 }
 
@@ -100,6 +100,18 @@ describe OroGen.gamepad_websocket.GPIOStateWebsocketPublisherTask do
             assert_websocket_receives_expected_message(@ws, expected)
         end
 
+        it "sends the latest state alongside the ID to clients connecting later" do
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([true, false])
+            end.to { have_one_new_sample(task.statistics_port) }
+
+            ws = websocket_create(identifier: nil)
+            msg = assert_websocket_receives_message(ws)
+            assert_equal "js", msg["id"]
+            assert_equal [{ "pressed" => true }, { "pressed" => false }],
+                         msg["state"]["buttons"]
+        end
+
         it "publishes the raw command message in a JSON format to all connected " \
            "clients" do
             ws2 = websocket_create
@@ -119,7 +131,166 @@ describe OroGen.gamepad_websocket.GPIOStateWebsocketPublisherTask do
         end
     end
 
-    def gpio_state(buttons)
-        { states: buttons.map { |s| { data: s } } }
+    describe "debouncing" do
+        before do
+            task.properties.debounce_window = [Time.at(10)]
+            syskit_configure_and_start(task)
+            @ws = websocket_create
+        end
+
+        it "publishes a change once it is stable for the window, with the time of " \
+           "its edge" do
+            t = Time.now
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([false], time: t)
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_websocket_receives_message(@ws)
+
+            [[true, 1], [false, 1.01], [true, 1.02]].each do |value, offset|
+                expect_execution do
+                    syskit_write task.gpio_state_port,
+                                 gpio_state([value], time: t + offset)
+                end.to { have_no_new_sample(task.statistics_port, at_least_during: 0.1) }
+            end
+
+            actual = expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([true], time: t + 12)
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 3, actual.filtered_samples
+
+            msg = assert_websocket_receives_message(@ws)
+            assert_equal [{ "pressed" => true }], msg["buttons"]
+            assert_in_delta (t + 1.02).to_f * 1000, msg["timestamp"], 1
+        end
+
+        it "measures the window with the time of the samples, not the current time" do
+            # Samples from the past, e.g. replayed, are held for the window like
+            # live ones while the task polls on its timeout
+            t = Time.at(1000)
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([false], time: t)
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_websocket_receives_message(@ws)
+
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([true], time: t + 1)
+            end.to { have_no_new_sample(task.statistics_port, at_least_during: 1.5) }
+
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([true], time: t + 12)
+            end.to { have_one_new_sample(task.statistics_port) }
+            msg = assert_websocket_receives_message(@ws)
+            assert_equal [{ "pressed" => true }], msg["buttons"]
+            assert_in_delta (t + 1).to_f * 1000, msg["timestamp"], 1
+        end
+    end
+
+    describe "per-pin debouncing" do
+        before do
+            task.properties.debounce_window = [Time.at(1), Time.at(10)]
+            syskit_configure_and_start(task)
+            @ws = websocket_create
+        end
+
+        it "holds each pin for its own window" do
+            t = Time.at(1000)
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([false, false], time: t)
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_websocket_receives_message(@ws)
+
+            execute do
+                syskit_write task.gpio_state_port, gpio_state([true, true], time: t + 1)
+            end
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([true, true], time: t + 3)
+            end.to { have_one_new_sample(task.statistics_port) }
+            msg = assert_websocket_receives_message(@ws)
+            assert_equal [{ "pressed" => true }, { "pressed" => false }], msg["buttons"]
+
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([true, true], time: t + 12)
+            end.to { have_one_new_sample(task.statistics_port) }
+            msg = assert_websocket_receives_message(@ws)
+            assert_equal [{ "pressed" => true }, { "pressed" => true }], msg["buttons"]
+        end
+
+        it "goes into size mismatch if a state does not have a window per pin" do
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([true, false, true])
+            end.to { emit task.size_mismatch_event }
+        end
+    end
+
+    describe "input batches" do
+        before do
+            task.properties.input_batch_size = 10
+        end
+
+        it "processes a burst of buffered states and publishes the newest" do
+            syskit_configure_and_start(task)
+            ws = websocket_create
+            writer = syskit_create_writer(task.gpio_state_port, type: :buffer, size: 10)
+            states = [[true], [false], [true]]
+            actual = expect_execution do
+                states.each { |s| writer.write(gpio_state(s)) }
+            end.to do
+                have_one_new_sample(task.statistics_port)
+                    .matching { |s| s.last_published_sequence == 3 }
+            end
+
+            messages = websocket_receive_messages_until(ws) { |m| m["seq"] == 3 }
+            assert_equal [{ "pressed" => true }], messages.last["buttons"]
+            # The states that were not sent are accounted for, however the burst was
+            # split between the update cycles
+            assert_equal 3, messages.size + actual.overwritten_samples
+        end
+
+        it "publishes the debounced transition of a burst with the time of its " \
+           "edge" do
+            task.properties.debounce_window = [Time.at(1)]
+            syskit_configure_and_start(task)
+            ws = websocket_create
+            t = Time.at(1000)
+            expect_execution do
+                syskit_write task.gpio_state_port, gpio_state([false], time: t)
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_websocket_receives_message(ws)
+
+            writer = syskit_create_writer(task.gpio_state_port, type: :buffer, size: 10)
+            burst = [t + 1, t + 2.5, t + 3].map { |time| gpio_state([true], time: time) }
+            actual = expect_execution do
+                burst.each { |s| writer.write(s) }
+            end.to do
+                have_one_new_sample(task.statistics_port)
+                    .matching { |s| s.last_published_sequence == 2 }
+            end
+
+            messages = websocket_receive_messages_until(ws) { |m| m["seq"] == 2 }
+            assert_equal 1, messages.size
+            assert_equal [{ "pressed" => true }], messages.last["buttons"]
+            assert_in_delta (t + 1).to_f * 1000, messages.last["timestamp"], 1
+            # The states that are not transitions are filtered out
+            assert_equal 3,
+                         messages.size + actual.overwritten_samples +
+                         actual.filtered_samples
+        end
+    end
+
+    it "publishes the current state again after the refresh period" do
+        task.properties.refresh_period = Time.at(0.1)
+        syskit_configure_and_start(task)
+        ws = websocket_create
+        expect_execution do
+            syskit_write task.gpio_state_port, gpio_state([true])
+        end.to { have_one_new_sample(task.statistics_port) }
+        assert_websocket_receives_message(ws)
+
+        msg = assert_websocket_receives_message(ws)
+        assert_equal [{ "pressed" => true }], msg["buttons"]
+    end
+
+    def gpio_state(buttons, time: Time.at(0))
+        { time: time, states: buttons.map { |s| { data: s, time: time } } }
     end
 end
@@ -2,6 +2,8 @@
 
 require "kontena-websocket-client"
 require "json"
+require "socket"
+require "tmpdir"
 require_relative "test_helpers"
 
 using_task_library "gamepad_websocket"
@@ -38,6 +40,50 @@ describe OroGen.gamepad_websocket.RawCommandWebsocketPublisherTask do
             .to { emit task.interrupt_event }
     end
 
+    it "keeps the clients connected when stopped and notifies them" do
+        syskit_configure_and_start(task)
+        write_device_identifier
+        ws = websocket_create
+
+        expect_execution { task.stop! }
+            .to { emit task.interrupt_event }
+        msg = assert_websocket_receives_message(ws)
+        assert_equal "paused", msg["status"]
+        assert ws.connection_thread.alive?
+    end
+
+    it "sends a fresh handshake to all clients after a restart" do
+        syskit_configure_and_start(task)
+        write_device_identifier
+        expect_execution { syskit_write task.raw_command_port, raw_command([0.5], []) }
+            .to { emit task.publishing_event }
+        ws = websocket_create
+        expect_execution { task.stop! }
+            .to { emit task.interrupt_event }
+
+        # Sequence numbers restart at 1, the handshake state from the previous run
+        # must not be reused even though they match
+        @task = syskit_deploy(
+            OroGen.gamepad_websocket.RawCommandWebsocketPublisherTask
+                .deployed_as("websocket")
+        )
+        task.properties.port = @port
+        task.properties.endpoint = "/ws"
+        syskit_configure_and_start(task)
+        write_device_identifier(identifier: "other")
+        expect_execution do
+            syskit_write task.raw_command_port, raw_command([0.25], [], "other")
+        end.to { emit task.publishing_event }
+
+        # The client that stayed connected is handed the new identifier
+        msg = wait_for_handshake(ws)
+        assert_equal "other", msg["id"]
+
+        msg = wait_for_handshake(websocket_create(identifier: nil))
+        assert_equal "other", msg["id"]
+        assert_equal [0.25], msg["state"]["axes"]
+    end
+
     it "queues connections and sends the ID when it becomes known" do
         syskit_configure_and_start(task)
         ws = websocket_create(identifier: nil)
@@ -45,8 +91,8 @@ describe OroGen.gamepad_websocket.RawCommandWebsocketPublisherTask do
 
         # The server now knows the ID, and will send it to pending connections
         write_device_identifier(identifier: "test_id")
-        expected = { "id" => "test_id" }
-        assert_websocket_receives_expected_message(ws, expected)
+        msg = assert_websocket_receives_message(ws)
+        assert_equal "test_id", msg["id"]
 
         # Also verify that new connections get the ID immediately
         websocket_create(identifier: nil)
@@ -61,8 +107,8 @@ describe OroGen.gamepad_websocket.RawCommandWebsocketPublisherTask do
 
         # The server now knows the ID, and will send it to pending connections
         write_device_identifier(identifier: "js")
-        expected = { "id" => "TideWise js Joystick" }
-        assert_websocket_receives_expected_message(ws, expected)
+        msg = assert_websocket_receives_message(ws)
+        assert_equal "TideWise js Joystick", msg["id"]
     end
 
     it "transform the device identifier using the provided transformation" do
@@ -77,6 +123,26 @@ describe OroGen.gamepad_websocket.RawCommandWebsocketPublisherTask do
         expect_execution.scheduler(true).to { fail_to_start task }
     end
 
+    it "fails configure when udp_address is set without udp_port" do
+        task.properties.udp_address = "127.0.0.1"
+        expect_execution.scheduler(true).to { fail_to_start task }
+    end
+
+    it "writes the pipeline trace on demand" do
+        task.properties.trace_capacity = 1024
+        syskit_configure_and_start(task)
+        write_device_identifier
+
+        Dir.mktmpdir do |dir|
+            path = File.join(dir, "trace.json")
+            assert task.orocos_task.dumpTrace(path)
+            events = JSON.parse(File.read(path))["traceEvents"]
+            names = events.map { |e| e["name"] }
+            assert_includes names, "raw_command read"
+            assert_includes names, "encode"
+        end
+    end
+
     describe "connection diagnostics" do
         before do
             syskit_configure_and_start(task)
@@ -130,6 +196,25 @@ describe OroGen.gamepad_websocket.RawCommandWebsocketPublisherTask do
             end
         end
 
+        it "numbers the published samples and accounts for them in the statistics" do
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 1], [1, 0])
+            end.to { have_one_new_sample(task.statistics_port) }
+            first = assert_websocket_receives_message(@ws)
+
+            actual = expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 1], [1, 0])
+            end.to { have_one_new_sample(task.statistics_port) }
+            second = assert_websocket_receives_message(@ws)
+
+            assert_equal first["seq"] + 1, second["seq"]
+            assert_equal second["seq"], actual.last_published_sequence
+            assert_equal second["seq"], actual.received_samples
+            assert_equal 0, actual.overwritten_samples
+            assert_equal second["seq"],
+                         actual.sockets_statistics.first.last_sent_sequence
+        end
+
         it "go into INPUT MISTMATCH if the sample's device identifier changes" do
             raw_cmd = raw_command([0.5, 1], [1, 0], "macarena")
             syskit_write task.raw_command_port, raw_cmd
@@ -171,6 +256,448 @@ describe OroGen.gamepad_websocket.RawCommandWebsocketPublisherTask do
         end
     end
 
+    describe "sharding" do
+        before do
+            task.properties.shards = 2
+            syskit_configure_and_start(task)
+            write_device_identifier
+        end
+
+        it "publishes to the clients of all the shards" do
+            ws0 = websocket_create
+            @url = "ws://127.0.0.1:#{@port + 1}/ws"
+            ws1 = websocket_create
+
+            actual = expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 1], [1, 0])
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 2, actual.sockets_statistics.size
+            assert_equal 2, actual.skipped_frames.size
+
+            expected = { "axes" => [0.5, 1],
+                         "buttons" => [{ "pressed" => true }, { "pressed" => false }] }
+            [ws0, ws1].each do |ws_state|
+                assert_websocket_receives_expected_message(ws_state, expected)
+            end
+        end
+    end
+
+    describe "client admission" do
+        before do
+            task.properties.max_clients = 1
+        end
+
+        it "rejects connections beyond max_clients" do
+            syskit_configure_and_start(task)
+            write_device_identifier
+            websocket_create
+
+            actual = expect_execution do
+                websocket_create(identifier: nil)
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 1, actual.rejected_clients
+            assert_equal 1, actual.sockets_statistics.size
+        end
+
+        it "evicts the oldest connection if configured to" do
+            task.properties.client_admission_policy = :EVICT_OLDEST_CLIENT
+            syskit_configure_and_start(task)
+            write_device_identifier
+            websocket_create
+
+            actual = expect_execution do
+                websocket_create
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 1, actual.evicted_clients
+            assert_equal 1, actual.sockets_statistics.size
+        end
+    end
+
+    describe "logging" do
+        before do
+            task.properties.max_clients = 1
+            task.properties.log_level = :SERVER_LOG_WARNING
+        end
+
+        it "filters the messages below log_level and collapses the repeated ones" do
+            syskit_configure_and_start(task)
+            # Without the device ID, the client stays pending and its messages are
+            # reported as errors
+            ws = websocket_create(identifier: nil)
+            3.times { websocket_create(identifier: nil) }
+            websocket_send(ws, "test")
+
+            output = wait_for_deployment_output(/Got data from a connection/)
+            rejections = output.scan(/rejecting the new connection/).size
+            assert_equal 1, rejections, output
+            assert_match(/previous message repeated 2 times/, output)
+            # seasocks announces the listening port at the info level
+            refute_match(/Listening/, output)
+        end
+    end
+
+    describe "axis filtering" do
+        it "does not publish samples that do not change the axes meaningfully" do
+            task.properties.axis_deadband = [0.05]
+            task.properties.axis_min_change = [0.02]
+            syskit_configure_and_start(task)
+            write_device_identifier
+            @ws = websocket_create
+
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 0.01], [1, 0])
+            end.to { have_one_new_sample(task.statistics_port) }
+
+            # Filtered samples do not trigger a statistics update
+            execute do
+                syskit_write task.raw_command_port, raw_command([0.51, 0.03], [1, 0])
+            end
+            sleep 0.1
+
+            actual = expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.6, 0.03], [1, 0])
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 1, actual.filtered_samples
+
+            expected = { "axes" => [0.6, 0],
+                         "buttons" => [{ "pressed" => true }, { "pressed" => false }] }
+            assert_websocket_receives_expected_message(@ws, expected)
+        end
+
+        it "applies per-axis parameters" do
+            task.properties.axis_deadband = [0.05, 0.2]
+            task.properties.axis_min_change = [0.02, 0.1]
+            syskit_configure_and_start(task)
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 0.3], [])
+            end.to { have_one_new_sample(task.statistics_port) }
+            ws = websocket_create
+
+            # A change of 0.05 is enough on the first axis, but not on the second
+            execute do
+                syskit_write task.raw_command_port, raw_command([0.5, 0.35], [])
+            end
+            sleep 0.1
+            actual = expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.55, 0.35], [])
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 1, actual.filtered_samples
+
+            msg = assert_websocket_receives_message(ws)
+            assert_equal [0.55, 0.35], msg["axes"]
+        end
+
+        it "applies the per-axis deadband" do
+            task.properties.axis_deadband = [0.05, 0.2]
+            syskit_configure_and_start(task)
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.1, 0.1], [])
+            end.to { have_one_new_sample(task.statistics_port) }
+            msg = wait_for_handshake(websocket_create(identifier: nil))
+            assert_equal [0.1, 0], msg["state"]["axes"]
+        end
+
+        it "fails configure if the per-axis parameters have different sizes" do
+            task.properties.axis_deadband = [0.05, 0.2]
+            task.properties.axis_min_change = [0.02, 0.1, 0.1]
+            expect_execution.scheduler(true).to { fail_to_start task }
+        end
+
+        it "goes into axis count mismatch if a command does not match the per-axis " \
+           "parameters" do
+            task.properties.axis_deadband = [0.05, 0.2]
+            syskit_configure_and_start(task)
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 0.1, 0], [])
+            end.to { emit task.axis_count_mismatch_event }
+        end
+    end
+
+    describe "maximum sample age" do
+        before do
+            task.properties.max_sample_age = Time.at(0.1)
+        end
+
+        it "drops samples older than max_sample_age" do
+            syskit_configure_and_start(task)
+            write_device_identifier
+
+            old_cmd = raw_command([0.5, 1], [1, 0]).merge(time: Time.now - 1)
+            actual = expect_execution do
+                syskit_write task.raw_command_port, old_cmd
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 1, actual.stale_samples
+            assert_operator actual.last_published_sequence, :<, actual.received_samples
+        end
+
+        it "tags samples older than max_sample_age with their age if configured to" do
+            task.properties.stale_sample_policy = :TAG_STALE_SAMPLES
+            syskit_configure_and_start(task)
+            write_device_identifier
+            ws = websocket_create
+
+            old_cmd = raw_command([0.5, 1], [1, 0]).merge(time: Time.now - 1)
+            actual = expect_execution do
+                syskit_write task.raw_command_port, old_cmd
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 1, actual.stale_samples
+
+            msg = assert_websocket_receives_message(ws)
+            assert_operator msg["age"], :>=, 1000
+        end
+
+        it "leaves a stale state out of the handshake of late clients" do
+            syskit_configure_and_start(task)
+            write_stale_state
+            ws = nil
+            expect_execution { ws = websocket_create(identifier: nil) }.to do
+                have_one_new_sample(task.statistics_port)
+                    .matching { |s| s.stale_samples == 1 }
+            end
+            msg = wait_for_handshake(ws)
+            refute msg.key?("state")
+        end
+
+        it "tags a stale state in the handshake of late clients if configured to" do
+            task.properties.stale_sample_policy = :TAG_STALE_SAMPLES
+            syskit_configure_and_start(task)
+            write_stale_state
+            ws = nil
+            expect_execution { ws = websocket_create(identifier: nil) }.to do
+                have_one_new_sample(task.statistics_port)
+                    .matching { |s| s.stale_samples == 1 }
+            end
+            msg = wait_for_handshake(ws)
+            assert_equal [0.5], msg["state"]["axes"]
+            assert_operator msg["state"]["age"], :>=, 200
+        end
+
+        # Publishes a fresh sample, and waits for it to become older than
+        # max_sample_age
+        def write_stale_state
+            write_device_identifier
+            expect_execution do
+                syskit_write task.raw_command_port,
+                             raw_command([0.5], []).merge(time: Time.now)
+            end.to { have_one_new_sample(task.statistics_port) }
+            sleep 0.2
+        end
+    end
+
+    describe "bundle mode" do
+        before do
+            task.properties.bundle_max_samples = 2
+            syskit_configure_and_start(task)
+            write_device_identifier
+            @ws = websocket_create
+        end
+
+        it "publishes the queued samples in a single frame once the bundle is full" do
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 1], [1, 0])
+            end.to do
+                have_one_new_sample(task.statistics_port)
+            end
+
+            msg = assert_websocket_receives_message(@ws)
+            assert_equal [1, 2], msg["samples"].map { |s| s["seq"] }
+            samples = msg["samples"].map do |s|
+                s.reject { |k, _| %w[timestamp seq].include?(k) }
+            end
+            expected = [{ "axes" => [], "buttons" => [] },
+                        { "axes" => [0.5, 1],
+                          "buttons" => [{ "pressed" => true }, { "pressed" => false }] }]
+            assert_equal expected, samples
+        end
+    end
+
+    describe "bundle window" do
+        before do
+            task.properties.bundle_max_samples = 10
+            task.properties.bundle_window = Time.at(0.1)
+            syskit_configure_and_start(task)
+            write_device_identifier
+            # Let the bundle of the device identifier go
+            sleep 0.3
+            @ws = websocket_create
+        end
+
+        it "sends a partial bundle when its window expires, even if input stops" do
+            start = Time.now
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5], [])
+            end.to { have_one_new_sample(task.statistics_port) }
+            # Without new input, the task would otherwise only wake up on its 1s
+            # timeout
+            assert_operator Time.now - start, :<, 0.5
+
+            msg = assert_websocket_receives_message(@ws)
+            assert_equal [2], msg["samples"].map { |s| s["seq"] }
+        end
+    end
+
+    describe "priority buttons" do
+        before do
+            task.properties.priority_buttons = [0]
+            task.properties.bundle_max_samples = 10
+            syskit_configure_and_start(task)
+            write_device_identifier
+            @ws = websocket_create
+        end
+
+        it "flushes the bundle right away when a priority button changes" do
+            actual = expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5], [1, 0])
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 1, actual.priority_samples
+            assert_operator actual.max_priority_latency, :>=,
+                            actual.last_priority_latency
+
+            msg = assert_websocket_receives_message(@ws)
+            assert_equal [1, 2], msg["samples"].map { |s| s["seq"] }
+        end
+
+        it "keeps bundling the changes of the other buttons" do
+            # The priority button appears in this sample, which counts as a change
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5], [0, 1])
+            end.to { have_one_new_sample(task.statistics_port) }
+
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5], [0, 0])
+            end.to { have_no_new_sample(task.statistics_port, at_least_during: 0.2) }
+        end
+    end
+
+    describe "shared memory" do
+        before do
+            @shm_name = "/gamepad_websocket_test_#{Process.pid}"
+            task.properties.shm_name = @shm_name
+            task.properties.shm_capacity = 4
+        end
+
+        it "does not leave a segment behind when configure fails" do
+            server = TCPServer.new(@port)
+            expect_execution.scheduler(true).to { fail_to_start task }
+            refute File.exist?("/dev/shm#{@shm_name}")
+        ensure
+            server&.close
+        end
+
+        it "writes the outgoing samples in the shared memory ring" do
+            syskit_configure_and_start(task)
+            write_device_identifier
+            expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 1], [1, 0])
+            end.to { have_one_new_sample(task.statistics_port) }
+
+            segment = File.binread("/dev/shm#{@shm_name}")
+            magic, version, capacity = segment.unpack("L<3")
+            assert_equal [0x53575047, 1, 4], [magic, version, capacity]
+            write_index = segment[64, 8].unpack1("Q<")
+            assert_equal 2, write_index
+
+            # Header is 128 bytes, and the sample data starts after the lock and
+            # index of the slot
+            slot_size = segment[12, 4].unpack1("L<")
+            data = segment[128 + slot_size + 16, slot_size - 16]
+            sequence, _time, axis_count, button_count = data.unpack("Q<q<L<2")
+            assert_equal [2, 2, 2], [sequence, axis_count, button_count]
+            # 32 axes are reserved before the buttons
+            assert_equal [0.5, 1], data[24, 16].unpack("E2")
+            assert_equal [1, 0], data[24 + 32 * 8, 2].unpack("C2")
+        end
+    end
+
+    describe "input batches" do
+        before do
+            task.properties.input_batch_size = 10
+            syskit_configure_and_start(task)
+            write_device_identifier
+            @ws = websocket_create
+        end
+
+        it "processes a burst of buffered samples and publishes the newest" do
+            writer = syskit_create_writer(task.raw_command_port, type: :buffer, size: 10)
+            actual = expect_execution do
+                3.times { |i| writer.write(raw_command([i], [])) }
+            end.to do
+                have_one_new_sample(task.statistics_port)
+                    .matching { |s| s.last_published_sequence == 4 }
+            end
+
+            messages = websocket_receive_messages_until(@ws) { |m| m["seq"] == 4 }
+            assert_equal [2], messages.last["axes"]
+            # The samples that were not sent are accounted for, however the burst
+            # was split between the update cycles
+            assert_equal 3, messages.size + actual.overwritten_samples
+        end
+    end
+
+    describe "UDP side channel" do
+        before do
+            @udp = UDPSocket.new
+            @udp.bind("127.0.0.1", 0)
+            task.properties.udp_address = "127.0.0.1"
+            task.properties.udp_port = @udp.local_address.ip_port
+            syskit_configure_and_start(task)
+        end
+
+        after do
+            @udp.close
+        end
+
+        it "sends every published sample as a datagram" do
+            write_device_identifier
+            actual = expect_execution do
+                syskit_write task.raw_command_port, raw_command([0.5, 1], [1, 0])
+            end.to { have_one_new_sample(task.statistics_port) }
+            assert_equal 2, actual.udp_datagrams
+            assert_equal 0, actual.udp_send_failures
+
+            messages = Array.new(2) { udp_receive_message(@udp) }
+            assert_equal [1, 2], messages.map { |m| m["seq"] }
+            assert_equal [0.5, 1], messages.last["axes"]
+            assert_equal [{ "pressed" => true }, { "pressed" => false }],
+                         messages.last["buttons"]
+        end
+    end
+
+    def udp_receive_message(socket, timeout: 3)
+        unless IO.select([socket], nil, nil, timeout)
+            flunk("did not receive a datagram in #{timeout}s")
+        end
+        JSON.parse(socket.recvfrom(65_536).first)
+    end
+
+    # Waits for the output of the task's deployment to match the given pattern,
+    # and returns it
+    def wait_for_deployment_output(pattern, timeout: 3)
+        pid = task.execution_agent.orocos_process.pid
+        deadline = Time.now + timeout
+        while Time.now < deadline
+            path = Dir.glob(File.join(Roby.app.log_dir, "*-#{pid}.txt")).first
+            output = File.read(path) if path
+            return output if output&.match?(pattern)
+
+            sleep 0.1
+        end
+        flunk("the deployment output did not match #{pattern} in #{timeout}s")
+    end
+
+    def wait_for_handshake(state, timeout: 3)
+        deadline = Time.now + timeout
+        while Time.now < deadline
+            unless state.received_messages.empty?
+                msg = JSON.parse(state.received_messages.shift)
+                return msg if msg.key?("id")
+            end
+
+            sleep 0.1
+        end
+        flunk("did not receive a handshake in #{timeout}s")
+    end
+
     def raw_command(axes, buttons, id = "js")
         { axisValue: axes, buttonValue: buttons, deviceIdentifier: id }
     end
@@ -68,6 +68,22 @@ def wait_for_device_id(state, identifier: "js", timeout: 3)
     raise WebsocketMessageTimeout, "timed out waiting for device id #{identifier}"
 end
 
+# Receives the messages in order until one matches the block, and returns them all
+def websocket_receive_messages_until(state, timeout: 3)
+    messages = []
+    deadline = Time.now + timeout
+    while Time.now < deadline
+        if state.received_messages.empty?
+            sleep 0.1
+            next
+        end
+
+        messages << JSON.parse(state.received_messages.shift)
+        return messages if yield(messages.last)
+    end
+    raise WebsocketMessageTimeout, "did not receive the expected message in #{timeout}s"
+end
+
 def websocket_disconnect(state)
     ws = state.ws
     ws.close
@@ -92,6 +108,7 @@ def assert_websocket_receives_expected_message(state, expected, timeout: 3)
         unless state.received_messages.empty?
             msg = JSON.parse(state.received_messages.pop)
             msg.delete("timestamp")
+            msg.delete("seq")
             pass if msg == expected
             return
         end